@@ -1,8 +1,103 @@
 
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <signal.h>
+
+// The library scanner needs POSIX directory, path and thread APIs and is left
+// out of native Windows builds; the rest of the player stays portable.
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#define write _write
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#else
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define USE_SSE 1
+#endif
+
+#define PI 3.14159265358979323846
+#define FEATURE_DIM 16               // 12 chroma bins + 4 timbre summaries
+#define TIMBRE_WEIGHT 0.5f           // scale of each timbre value (in [-1, 1]) against the unit chroma profile
+#define CHROMA_OCTAVES 4             // octaves C3..B6 folded into each chroma bin
+#define ANALYSIS_FRAME 4096          // samples per analysis frame
+#define MAX_ANALYSIS_SECONDS 90      // only the opening of each track is analysed
+#define SCORE_BLOCK 256              // vectors scored per block during a scan
+#define SIMILAR_CANDIDATES 8         // neighbours fetched for "play similar next"
+#define FINGERPRINT_SEGMENTS 64      // time-local codes kept per song for duplicate checks
+#define FINGERPRINT_SEGMENT_MS 500   // audio summarised by one code
+#define FINGERPRINT_MAX_SHIFT 2      // segments two copies of a recording may be offset by
+#define SILENCE_RMS 0.001            // about -60 dBFS; leading audio below this is skipped
+#define LOUDNESS_STEP 1.25           // segment-to-segment change that counts as louder/quieter
+#define DUPLICATE_PREFILTER 0.98f    // cosine similarity a pair needs before its codes are compared
+#define DUPLICATE_MAX_DISTANCE 0.2f  // fraction of code bits two near-duplicates may differ in
+#define DUPLICATE_MIN_BITS 32        // set code bits needed for a meaningful comparison
+#define DUPLICATE_DURATION_SLACK 2   // seconds two duplicates may differ by
+#define MAX_PATH_LENGTH 1024
+#define MAX_SCAN_DEPTH 64            // folder nesting limit (guards symlink loops)
+#define SCAN_THREADS_MAX 16
+#define SCAN_CHUNK 64                // files claimed by a scan thread at a time
+#define HASH_SAMPLE_BYTES 4096       // audio bytes hashed at the start, middle and end for a stable song ID
+
+// Outcome of scanning one file
+#define SCAN_FAILED 0
+#define SCAN_UNCHANGED 1
+#define SCAN_READ 2
+
+// Operations covered by the latency statistics (build with -DNO_STATS to compile them out)
+#define OP_ADD_SONG 0
+#define OP_DELETE_SONG 1
+#define OP_SEARCH_SONG 2
+#define OP_SEARCH_ARTIST 3
+#define OP_JUMP_TO_SONG 4
+#define OP_SHUFFLE 5
+#define OP_REVERSE 6
+#define OP_PLAY 7
+#define OP_PLAY_NEXT 8
+#define OP_PLAY_PREVIOUS 9
+#define OP_PAUSE 10
+#define OP_STOP 11
+#define OP_ADD_AT_POSITION 12
+#define OP_DELETE_BY_TITLE 13
+#define OP_PLAY_SIMILAR 14
+#define OP_COUNT 15
+#define LATENCY_BUCKETS 40           // bucket b holds latencies in [2^b, 2^(b+1)) ns
+// Worst-case JSON size: per operation the keys, name and three 20-digit
+// counters (~135 bytes), plus every bucket as "<12-digit bound>":<20-digit count>
+#define STATS_OP_TEXT 192
+#define STATS_BUCKET_TEXT 40
+#define STATS_BUFFER_SIZE (OP_COUNT * (STATS_OP_TEXT + LATENCY_BUCKETS * STATS_BUCKET_TEXT) + 64)
+
+#ifdef NO_STATS
+#define STATS_START(op)
+#define STATS_VISIT()
+#define STATS_STOP(op)
+#else
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+#define STATS_START(op) struct timespec statsStart; long statsVisited = 0; readClock(&statsStart)
+#define STATS_VISIT() (statsVisited++)
+#define STATS_STOP(op) recordOperation((op), &statsStart, statsVisited)
+#endif
 
 // Structure to represent a song
 struct Song {
@@ -15,6 +110,117 @@ struct Song {
     struct Song* prev; // for doubly linked list
 };
 
+// Structure describing the PCM layout of a WAV file
+struct WavInfo {
+    int channels;
+    int sampleRate;
+    int bitsPerSample;
+    long dataOffset;        // file offset of the first sample
+    unsigned long dataSize; // bytes of sample data
+};
+
+// Structure for the acoustic similarity index
+// Feature vectors are unit length and stored contiguously so a query is a
+// single linear scan of dot products. Fingerprints are the per-segment codes
+// used to confirm near-duplicates. The table maps song IDs to slots (open
+// addressing, -1 marks an empty entry) so results resolve to nodes in O(1).
+struct SimilarityIndex {
+    float* vectors;          // count * FEATURE_DIM floats
+    uint16_t* fingerprints;  // count * FINGERPRINT_SEGMENTS codes
+    int* ids;
+    int* durations;
+    struct Song** songs;     // playlist node of each slot
+    int count;
+    int capacity;
+    int* table;
+    int tableCapacity;       // power of two
+};
+
+// Structure for the song fields read from an audio file header
+struct SongTags {
+    char title[100];
+    char artist[100];
+    char album[100];
+    int duration; // in seconds
+};
+
+// Structure describing one MPEG audio frame header
+struct MpegFrame {
+    int bitrate;    // bits per second
+    int sampleRate;
+    int samplesPerFrame;
+    int sideInfo;   // bytes between the frame header and a Xing/Info tag
+};
+
+// Structure for a set of song IDs (open addressing, 0 marks an empty slot)
+struct IdSet {
+    int* slots;
+    int capacity; // power of two
+    int count;
+};
+
+// Structure mapping song IDs to playlist nodes (open addressing, NULL marks an empty slot)
+struct SongMap {
+    struct Song** slots;
+    int capacity; // power of two
+};
+
+// Structure remembering one scanned file between rescans
+struct LibraryEntry {
+    char* path; // NULL marks an empty slot
+    long long mtime;
+    long long size;
+    unsigned long long hash; // content hash, used to follow renamed files
+    int id;            // 0 once the ID has moved to a renamed file's entry
+    int present;  // song is currently in the playlist
+    int lastSeen; // scan generation that last found the file
+};
+
+// Structure for the library cache (open addressing keyed by path)
+struct LibraryCache {
+    struct LibraryEntry* entries;
+    int capacity; // power of two
+    int count;
+    int generation;
+    struct IdSet ids; // every ID handed out by the scanner
+};
+
+// Structure for one file waiting to be scanned
+struct ScanJob {
+    char* path;
+    struct LibraryEntry* cached; // NULL if the file was never scanned
+    long long mtime;
+    long long size;
+    unsigned long long hash;
+    struct SongTags* tags; // filled when status is SCAN_READ
+    struct Song* song;     // new playlist node created for this file
+    int status;
+};
+
+#ifndef _WIN32
+// Structure for the work shared by the scan threads
+struct ScanQueue {
+    struct ScanJob* jobs;
+    int count;
+    int next; // first job not yet claimed
+    pthread_mutex_t lock;
+};
+#endif
+
+// Structure for the counters of one operation
+struct OperationStats {
+    unsigned long long calls;
+    unsigned long long nodesVisited; // playlist nodes examined by searches and traversals
+    unsigned long long totalNanos;
+    unsigned long long buckets[LATENCY_BUCKETS];
+};
+
+// Structure for one thread's counters (written only by that thread)
+struct ThreadStats {
+    struct OperationStats ops[OP_COUNT];
+    struct ThreadStats* next;
+};
+
 // Structure for the music player
 struct MusicPlayer {
     struct Song* head;
@@ -23,15 +229,21 @@ struct MusicPlayer {
     int totalSongs;
     int isPlaying;
     int currentPosition; // position in seconds
+    struct SimilarityIndex similar;
+    struct LibraryCache library;
 };
 
 // Function prototypes
 struct Song* createSong(int id, const char* title, const char* artist, const char* album, int duration);
 void initPlayer(struct MusicPlayer* player);
 void addSong(struct MusicPlayer* player, int id, const char* title, const char* artist, const char* album, int duration);
+void addSongBatch(struct MusicPlayer* player, struct Song* first, struct Song* last, int count);
+void appendSong(struct MusicPlayer* player, struct Song* newSong);
+void detachSong(struct MusicPlayer* player, struct Song* song);
 void addSongAtPosition(struct MusicPlayer* player, int position, int id, const char* title, const char* artist, const char* album, int duration);
 void deleteSong(struct MusicPlayer* player, int id);
 void deleteSongByTitle(struct MusicPlayer* player, const char* title);
+void startPlayback(struct MusicPlayer* player);
 void playCurrentSong(struct MusicPlayer* player);
 void playNext(struct MusicPlayer* player);
 void playPrevious(struct MusicPlayer* player);
@@ -48,6 +260,27 @@ struct Song* searchSongByArtist(struct MusicPlayer* player, const char* artist);
 void jumpToSong(struct MusicPlayer* player, int id);
 void clearPlaylist(struct MusicPlayer* player);
 int getPlaylistLength(struct MusicPlayer* player);
+int readWavHeader(FILE* file, struct WavInfo* info);
+int extractAudioFeatures(const char* path, float* features, uint16_t* fingerprint, int* duration);
+void initIndex(struct SimilarityIndex* index);
+void freeIndex(struct SimilarityIndex* index);
+int indexSong(struct SimilarityIndex* index, struct Song* song, int duration, const float* features, const uint16_t* fingerprint);
+void removeFromIndex(struct SimilarityIndex* index, int id);
+void removeIdsFromIndex(struct SimilarityIndex* index, const struct IdSet* ids);
+int findSimilarSongs(struct SimilarityIndex* index, const float* query, int k, int excludeId, int* outIds, float* outScores);
+void analyzeSongAudio(struct MusicPlayer* player, int id, const char* path);
+void playSimilarNext(struct MusicPlayer* player);
+void findNearDuplicates(struct MusicPlayer* player);
+void initLibraryCache(struct LibraryCache* cache);
+void freeLibraryCache(struct LibraryCache* cache);
+int readSongTags(const char* path, long long fileSize, struct SongTags* tags, unsigned long long* hash);
+void scanLibrary(struct MusicPlayer* player, const char* folder);
+#ifndef NO_STATS
+void readClock(struct timespec* now);
+void recordOperation(int op, const struct timespec* start, long visited);
+size_t formatStatsJson(char* buffer, size_t size);
+#endif
+void dumpStats();
 void displayMenu();
 
 // Function to create a new song node
@@ -77,13 +310,12 @@ void initPlayer(struct MusicPlayer* player) {
     player->totalSongs = 0;
     player->isPlaying = 0;
     player->currentPosition = 0;
+    initIndex(&player->similar);
+    initLibraryCache(&player->library);
 }
 
-// Add a song to the end of the playlist
-void addSong(struct MusicPlayer* player, int id, const char* title, const char* artist, const char* album, int duration) {
-    struct Song* newSong = createSong(id, title, artist, album, duration);
-    if (newSong == NULL) return;
-
+// Link a new node after the tail of the playlist
+void appendSong(struct MusicPlayer* player, struct Song* newSong) {
     if (player->head == NULL) {
         // First song in playlist
         player->head = newSong;
@@ -97,23 +329,62 @@ void addSong(struct MusicPlayer* player, int id, const char* title, const char*
     }
 
     player->totalSongs++;
+}
+
+// Add a song to the end of the playlist
+void addSong(struct MusicPlayer* player, int id, const char* title, const char* artist, const char* album, int duration) {
+    STATS_START(OP_ADD_SONG);
+
+    struct Song* newSong = createSong(id, title, artist, album, duration);
+    if (newSong == NULL) {
+        STATS_STOP(OP_ADD_SONG);
+        return;
+    }
+
+    appendSong(player, newSong);
     printf("Song '%s' by %s added to playlist!\n", title, artist);
+    STATS_STOP(OP_ADD_SONG);
+}
+
+// Append an already linked chain of songs in one step
+void addSongBatch(struct MusicPlayer* player, struct Song* first, struct Song* last, int count) {
+    if (first == NULL) return;
+
+    if (player->head == NULL) {
+        player->head = first;
+        player->current = first;
+    } else {
+        player->tail->next = first;
+        first->prev = player->tail;
+    }
+
+    player->tail = last;
+    player->totalSongs += count;
+    printf("%d song(s) added to playlist!\n", count);
 }
 
 // Add song at specific position
 void addSongAtPosition(struct MusicPlayer* player, int position, int id, const char* title, const char* artist, const char* album, int duration) {
+    STATS_START(OP_ADD_AT_POSITION);
+
     if (position < 1 || position > player->totalSongs + 1) {
         printf("Invalid position!\n");
+        STATS_STOP(OP_ADD_AT_POSITION);
         return;
     }
 
-    if (position == player->totalSongs + 1) {
-        addSong(player, id, title, artist, album, duration);
+    struct Song* newSong = createSong(id, title, artist, album, duration);
+    if (newSong == NULL) {
+        STATS_STOP(OP_ADD_AT_POSITION);
         return;
     }
 
-    struct Song* newSong = createSong(id, title, artist, album, duration);
-    if (newSong == NULL) return;
+    if (position == player->totalSongs + 1) {
+        appendSong(player, newSong);
+        printf("Song '%s' by %s added to playlist!\n", title, artist);
+        STATS_STOP(OP_ADD_AT_POSITION);
+        return;
+    }
 
     if (position == 1) {
         // Insert at beginning
@@ -124,6 +395,7 @@ void addSongAtPosition(struct MusicPlayer* player, int position, int id, const c
         // Insert at middle
         struct Song* temp = player->head;
         for (int i = 1; i < position; i++) {
+            STATS_VISIT();
             temp = temp->next;
         }
 
@@ -135,85 +407,107 @@ void addSongAtPosition(struct MusicPlayer* player, int position, int id, const c
 
     player->totalSongs++;
     printf("Song '%s' by %s inserted at position %d!\n", title, artist, position);
+    STATS_STOP(OP_ADD_AT_POSITION);
+}
+
+// Unlink a song from the playlist without freeing it
+void detachSong(struct MusicPlayer* player, struct Song* song) {
+    // Update current pointer if necessary
+    if (player->current == song) {
+        if (song->next != NULL) {
+            player->current = song->next;
+        } else if (song->prev != NULL) {
+            player->current = song->prev;
+        } else {
+            player->current = NULL;
+        }
+    }
+
+    // Remove from list
+    if (song->prev != NULL) {
+        song->prev->next = song->next;
+    } else {
+        player->head = song->next;
+    }
+
+    if (song->next != NULL) {
+        song->next->prev = song->prev;
+    } else {
+        player->tail = song->prev;
+    }
+
+    song->next = NULL;
+    song->prev = NULL;
+    player->totalSongs--;
 }
 
 // Delete song by ID
 void deleteSong(struct MusicPlayer* player, int id) {
+    STATS_START(OP_DELETE_SONG);
+
     if (player->head == NULL) {
         printf("Playlist is empty!\n");
+        STATS_STOP(OP_DELETE_SONG);
         return;
     }
 
     struct Song* temp = player->head;
 
     // Find the song
-    while (temp != NULL && temp->id != id) {
+    while (temp != NULL) {
+        STATS_VISIT();
+        if (temp->id == id) break;
         temp = temp->next;
     }
 
     if (temp == NULL) {
         printf("Song with ID %d not found!\n", id);
+        STATS_STOP(OP_DELETE_SONG);
         return;
     }
 
-    // Update current pointer if necessary
-    if (player->current == temp) {
-        if (temp->next != NULL) {
-            player->current = temp->next;
-        } else if (temp->prev != NULL) {
-            player->current = temp->prev;
-        } else {
-            player->current = NULL;
-        }
-    }
-
-    // Remove from list
-    if (temp->prev != NULL) {
-        temp->prev->next = temp->next;
-    } else {
-        player->head = temp->next;
-    }
-
-    if (temp->next != NULL) {
-        temp->next->prev = temp->prev;
-    } else {
-        player->tail = temp->prev;
-    }
-
+    detachSong(player, temp);
     printf("Song '%s' deleted from playlist!\n", temp->title);
+    removeFromIndex(&player->similar, temp->id);
     free(temp);
-    player->totalSongs--;
+    STATS_STOP(OP_DELETE_SONG);
 }
 
 // Delete song by title
 void deleteSongByTitle(struct MusicPlayer* player, const char* title) {
+    STATS_START(OP_DELETE_BY_TITLE);
+
     if (player->head == NULL) {
         printf("Playlist is empty!\n");
+        STATS_STOP(OP_DELETE_BY_TITLE);
         return;
     }
 
     struct Song* temp = player->head;
 
     // Find the song
-    while (temp != NULL && strcmp(temp->title, title) != 0) {
+    while (temp != NULL) {
+        STATS_VISIT();
+        if (strcmp(temp->title, title) == 0) break;
         temp = temp->next;
     }
 
     if (temp == NULL) {
         printf("Song '%s' not found!\n", title);
+        STATS_STOP(OP_DELETE_BY_TITLE);
         return;
     }
 
-    deleteSong(player, temp->id);
+    detachSong(player, temp);
+    printf("Song '%s' deleted from playlist!\n", temp->title);
+    removeFromIndex(&player->similar, temp->id);
+    free(temp);
+    STATS_STOP(OP_DELETE_BY_TITLE);
 }
 
-// Play current song
-void playCurrentSong(struct MusicPlayer* player) {
-    if (player->current == NULL) {
-        printf("No song selected or playlist is empty!\n");
-        return;
-    }
-
+// Start playing player->current (which must be set)
+// Shared by every playback transition so each is recorded only under its own name.
+void startPlayback(struct MusicPlayer* player) {
     player->isPlaying = 1;
     player->currentPosition = 0;
     printf("\nNow Playing: '%s' by %s\n", player->current->title, player->current->artist);
@@ -223,34 +517,58 @@ void playCurrentSong(struct MusicPlayer* player) {
            player->current->duration % 60);
 }
 
+// Play current song
+void playCurrentSong(struct MusicPlayer* player) {
+    STATS_START(OP_PLAY);
+
+    if (player->current == NULL) {
+        printf("No song selected or playlist is empty!\n");
+        STATS_STOP(OP_PLAY);
+        return;
+    }
+
+    startPlayback(player);
+    STATS_STOP(OP_PLAY);
+}
+
 // Play next song
 void playNext(struct MusicPlayer* player) {
+    STATS_START(OP_PLAY_NEXT);
+
     if (player->current == NULL) {
         printf("No current song!\n");
+        STATS_STOP(OP_PLAY_NEXT);
         return;
     }
 
     if (player->current->next != NULL) {
         player->current = player->current->next;
-        playCurrentSong(player);
+        startPlayback(player);
     } else {
         printf("This is the last song in the playlist!\n");
     }
+
+    STATS_STOP(OP_PLAY_NEXT);
 }
 
 // Play previous song
 void playPrevious(struct MusicPlayer* player) {
+    STATS_START(OP_PLAY_PREVIOUS);
+
     if (player->current == NULL) {
         printf("No current song!\n");
+        STATS_STOP(OP_PLAY_PREVIOUS);
         return;
     }
 
     if (player->current->prev != NULL) {
         player->current = player->current->prev;
-        playCurrentSong(player);
+        startPlayback(player);
     } else {
         printf("This is the first song in the playlist!\n");
     }
+
+    STATS_STOP(OP_PLAY_PREVIOUS);
 }
 
 // Peek at next song without playing
@@ -291,16 +609,22 @@ struct Song* peekPrevious(struct MusicPlayer* player) {
 
 // Pause current song
 void pauseSong(struct MusicPlayer* player) {
+    STATS_START(OP_PAUSE);
+
     if (player->isPlaying) {
         player->isPlaying = 0;
         printf("Song paused!\n");
     } else {
         printf("No song is currently playing!\n");
     }
+
+    STATS_STOP(OP_PAUSE);
 }
 
 // Stop current song
 void stopSong(struct MusicPlayer* player) {
+    STATS_START(OP_STOP);
+
     if (player->isPlaying || player->currentPosition > 0) {
         player->isPlaying = 0;
         player->currentPosition = 0;
@@ -308,6 +632,8 @@ void stopSong(struct MusicPlayer* player) {
     } else {
         printf("No song is currently playing!\n");
     }
+
+    STATS_STOP(OP_STOP);
 }
 
 // Display entire playlist
@@ -319,15 +645,16 @@ void displayPlaylist(struct MusicPlayer* player) {
 
     printf("\n=== PLAYLIST ===\n");
     printf("Total Songs: %d\n", player->totalSongs);
-    printf("%-3s %-25s %-20s %-20s %-8s\n", "ID", "Title", "Artist", "Album", "Duration");
-    printf("-------------------------------------------------------------------------\n");
+    // Scanned songs have content-hash IDs of up to 10 digits
+    printf(" %-10s %-25s %-20s %-20s %-8s\n", "ID", "Title", "Artist", "Album", "Duration");
+    printf("--------------------------------------------------------------------------------------\n");
 
     struct Song* temp = player->head;
     int position = 1;
 
     while (temp != NULL) {
         char indicator = (temp == player->current) ? '>' : ' ';
-        printf("%c%-3d %-25s %-20s %-20s %02d:%02d\n", 
+        printf("%c%-10d %-25s %-20s %-20s %02d:%02d\n", 
                indicator,
                temp->id, 
                temp->title, 
@@ -363,8 +690,11 @@ void displayCurrentSong(struct MusicPlayer* player) {
 
 // Shuffle playlist
 void shufflePlaylist(struct MusicPlayer* player) {
+    STATS_START(OP_SHUFFLE);
+
     if (player->totalSongs < 2) {
         printf("Need at least 2 songs to shuffle!\n");
+        STATS_STOP(OP_SHUFFLE);
         return;
     }
 
@@ -374,6 +704,7 @@ void shufflePlaylist(struct MusicPlayer* player) {
 
     // Fill array
     for (int i = 0; i < player->totalSongs; i++) {
+        STATS_VISIT();
         songArray[i] = temp;
         temp = temp->next;
     }
@@ -404,12 +735,16 @@ void shufflePlaylist(struct MusicPlayer* player) {
 
     free(songArray);
     printf("Playlist shuffled successfully!\n");
+    STATS_STOP(OP_SHUFFLE);
 }
 
 // Reverse playlist
 void reversePlaylist(struct MusicPlayer* player) {
+    STATS_START(OP_REVERSE);
+
     if (player->head == NULL) {
         printf("Playlist is empty!\n");
+        STATS_STOP(OP_REVERSE);
         return;
     }
 
@@ -418,6 +753,7 @@ void reversePlaylist(struct MusicPlayer* player) {
 
     // Swap next and prev for all nodes
     while (current != NULL) {
+        STATS_VISIT();
         temp = current->prev;
         current->prev = current->next;
         current->next = temp;
@@ -430,27 +766,35 @@ void reversePlaylist(struct MusicPlayer* player) {
     player->tail = temp;
 
     printf("Playlist reversed successfully!\n");
+    STATS_STOP(OP_REVERSE);
 }
 
 // Search song by title
 struct Song* searchSong(struct MusicPlayer* player, const char* title) {
+    STATS_START(OP_SEARCH_SONG);
+
     struct Song* temp = player->head;
 
     while (temp != NULL) {
+        STATS_VISIT();
         if (strcmp(temp->title, title) == 0) {
             printf("Song found: '%s' by %s (ID: %d)\n", 
                    temp->title, temp->artist, temp->id);
+            STATS_STOP(OP_SEARCH_SONG);
             return temp;
         }
         temp = temp->next;
     }
 
     printf("Song '%s' not found!\n", title);
+    STATS_STOP(OP_SEARCH_SONG);
     return NULL;
 }
 
 // Search songs by artist
 struct Song* searchSongByArtist(struct MusicPlayer* player, const char* artist) {
+    STATS_START(OP_SEARCH_ARTIST);
+
     struct Song* temp = player->head;
     struct Song* found = NULL;
     int count = 0;
@@ -458,6 +802,7 @@ struct Song* searchSongByArtist(struct MusicPlayer* player, const char* artist)
     printf("Songs by %s:\n", artist);
 
     while (temp != NULL) {
+        STATS_VISIT();
         if (strcmp(temp->artist, artist) == 0) {
             printf("- '%s' (ID: %d)\n", temp->title, temp->id);
             if (found == NULL) found = temp; // Return first match
@@ -472,23 +817,29 @@ struct Song* searchSongByArtist(struct MusicPlayer* player, const char* artist)
         printf("Found %d song(s) by %s\n", count, artist);
     }
 
+    STATS_STOP(OP_SEARCH_ARTIST);
     return found;
 }
 
 // Jump to specific song by ID
 void jumpToSong(struct MusicPlayer* player, int id) {
+    STATS_START(OP_JUMP_TO_SONG);
+
     struct Song* temp = player->head;
 
     while (temp != NULL) {
+        STATS_VISIT();
         if (temp->id == id) {
             player->current = temp;
-            playCurrentSong(player);
+            startPlayback(player);
+            STATS_STOP(OP_JUMP_TO_SONG);
             return;
         }
         temp = temp->next;
     }
 
     printf("Song with ID %d not found!\n", id);
+    STATS_STOP(OP_JUMP_TO_SONG);
 }
 
 // Clear entire playlist
@@ -504,6 +855,8 @@ void clearPlaylist(struct MusicPlayer* player) {
     player->totalSongs = 0;
     player->isPlaying = 0;
     player->currentPosition = 0;
+    freeIndex(&player->similar);
+    freeLibraryCache(&player->library);
 
     printf("Playlist cleared!\n");
 }
@@ -513,137 +866,1888 @@ int getPlaylistLength(struct MusicPlayer* player) {
     return player->totalSongs;
 }
 
-// Display menu
-void displayMenu() {
-    printf("\n=== MUSIC PLAYER MENU ===\n");
-    printf("1.  Add song to playlist\n");
-    printf("2.  Add song at specific position\n");
-    printf("3.  Delete song by ID\n");
-    printf("4.  Delete song by title\n");
-    printf("5.  Play current song\n");
-    printf("6.  Play next song\n");
-    printf("7.  Play previous song\n");
-    printf("8.  Peek next song\n");
-    printf("9.  Peek previous song\n");
-    printf("10. Pause song\n");
-    printf("11. Stop song\n");
-    printf("12. Display playlist\n");
-    printf("13. Display current song\n");
-    printf("14. Search song by title\n");
-    printf("15. Search songs by artist\n");
-    printf("16. Jump to song by ID\n");
-    printf("17. Shuffle playlist\n");
-    printf("18. Reverse playlist\n");
-    printf("19. Clear playlist\n");
-    printf("20. Get playlist length\n");
-    printf("0.  Exit\n");
-    printf("Enter your choice: ");
+// Read little-endian integers from a byte buffer
+static unsigned int readLE16(const unsigned char* bytes) {
+    return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8);
 }
 
-// Main function
-int main() {
-    struct MusicPlayer player;
-    initPlayer(&player);
+static unsigned long readLE32(const unsigned char* bytes) {
+    return (unsigned long)bytes[0] | ((unsigned long)bytes[1] << 8) |
+           ((unsigned long)bytes[2] << 16) | ((unsigned long)bytes[3] << 24);
+}
 
-    int choice;
-    int id, position, duration;
-    char title[100], artist[100], album[100];
+// Parse the RIFF/WAVE header and leave the file positioned at the sample data
+// Returns 0 on success, -1 if the file is not integer PCM WAV.
+int readWavHeader(FILE* file, struct WavInfo* info) {
+    unsigned char header[12];
+    unsigned char chunk[8];
+    int haveFormat = 0;
 
-    printf("Welcome to the Music Player!\n");
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        return -1;
+    }
 
-    // Add some sample songs
-    addSong(&player, 1, "Bohemian Rhapsody", "Queen", "A Night at the Opera", 355);
-    addSong(&player, 2, "Hotel California", "Eagles", "Hotel California", 391);
-    addSong(&player, 3, "Sweet Child O' Mine", "Guns N' Roses", "Appetite for Destruction", 356);
-    addSong(&player, 4, "Stairway to Heaven", "Led Zeppelin", "Led Zeppelin IV", 482);
-    addSong(&player, 5, "Imagine", "John Lennon", "Imagine", 183);
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk)) {
+        unsigned long size = readLE32(chunk + 4);
+        long skip = (long)(size + (size & 1)); // chunks are word aligned
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            // PCM subformat GUID of WAVE_FORMAT_EXTENSIBLE, minus its leading format code
+            static const unsigned char pcmGuidTail[14] = {
+                0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+            };
+            unsigned char format[40];
+            size_t length = size < sizeof(format) ? size : sizeof(format);
+            if (length < 16 || fread(format, 1, length, file) != length) {
+                return -1;
+            }
+
+            unsigned int formatTag = readLE16(format);
+            info->channels = (int)readLE16(format + 2);
+            info->sampleRate = (int)readLE32(format + 4);
+            info->bitsPerSample = (int)readLE16(format + 14);
+
+            // Extensible files carry the real format code in the SubFormat GUID
+            if (formatTag == 0xFFFE) {
+                if (length < 40 || memcmp(format + 26, pcmGuidTail, sizeof(pcmGuidTail)) != 0) return -1;
+                formatTag = readLE16(format + 24);
+            }
+
+            if (formatTag != 1 || info->channels < 1 || info->sampleRate < 1 ||
+                info->bitsPerSample % 8 != 0 || info->bitsPerSample < 8 || info->bitsPerSample > 32) {
+                return -1;
+            }
+
+            haveFormat = 1;
+            skip -= (long)length;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) return -1;
+            info->dataOffset = ftell(file);
+            info->dataSize = size;
+            return 0;
+        }
 
-    do {
-        displayMenu();
-        scanf("%d", &choice);
-        getchar(); // consume newline
+        if (fseek(file, skip, SEEK_CUR) != 0) return -1;
+    }
 
-        switch (choice) {
-            case 1:
-                printf("Enter song details:\n");
-                printf("ID: ");
-                scanf("%d", &id);
-                getchar();
-                printf("Title: ");
-                fgets(title, sizeof(title), stdin);
-                title[strcspn(title, "\n")] = 0; // remove newline
-                printf("Artist: ");
-                fgets(artist, sizeof(artist), stdin);
-                artist[strcspn(artist, "\n")] = 0;
-                printf("Album: ");
-                fgets(album, sizeof(album), stdin);
-                album[strcspn(album, "\n")] = 0;
-                printf("Duration (seconds): ");
-                scanf("%d", &duration);
-                addSong(&player, id, title, artist, album, duration);
-                break;
+    return -1;
+}
 
-            case 2:
-                printf("Enter position: ");
-                scanf("%d", &position);
-                printf("Enter song details:\n");
-                printf("ID: ");
-                scanf("%d", &id);
-                getchar();
-                printf("Title: ");
-                fgets(title, sizeof(title), stdin);
-                title[strcspn(title, "\n")] = 0;
-                printf("Artist: ");
-                fgets(artist, sizeof(artist), stdin);
-                artist[strcspn(artist, "\n")] = 0;
-                printf("Album: ");
-                fgets(album, sizeof(album), stdin);
-                album[strcspn(album, "\n")] = 0;
-                printf("Duration (seconds): ");
-                scanf("%d", &duration);
-                addSongAtPosition(&player, position, id, title, artist, album, duration);
-                break;
+// Convert one little-endian PCM sample to the range [-1, 1]
+static float decodeSample(const unsigned char* bytes, int bytesPerSample) {
+    switch (bytesPerSample) {
+        case 1:
+            return ((int)bytes[0] - 128) / 128.0f;
+        case 2:
+            return (int16_t)readLE16(bytes) / 32768.0f;
+        case 3: {
+            long value = (long)bytes[0] | ((long)bytes[1] << 8) | ((long)bytes[2] << 16);
+            if (value & 0x800000L) value -= 0x1000000L;
+            return value / 8388608.0f;
+        }
+        default:
+            return (float)((int32_t)readLE32(bytes) / 2147483648.0);
+    }
+}
 
-            case 3:
-                printf("Enter song ID to delete: ");
-                scanf("%d", &id);
-                deleteSong(&player, id);
-                break;
+// Scale a feature vector to unit length so dot products are cosine similarity
+static void normalizeVector(float* vector) {
+    double norm = 0;
+    for (int i = 0; i < FEATURE_DIM; i++) {
+        norm += (double)vector[i] * vector[i];
+    }
 
-            case 4:
-                printf("Enter song title to delete: ");
-                fgets(title, sizeof(title), stdin);
-                title[strcspn(title, "\n")] = 0;
-                deleteSongByTitle(&player, title);
-                break;
+    if (norm > 0) {
+        norm = sqrt(norm);
+        for (int i = 0; i < FEATURE_DIM; i++) {
+            vector[i] = (float)(vector[i] / norm);
+        }
+    }
+}
 
-            case 5:
-                playCurrentSong(&player);
-                break;
+// Exact length of a WAV file's audio in whole seconds
+// The data size is clamped to the file for streamed or truncated files.
+static int wavDuration(const struct WavInfo* info, long long fileSize) {
+    unsigned long long dataSize = info->dataSize;
+    if (info->dataOffset + (long long)dataSize > fileSize) {
+        dataSize = fileSize > info->dataOffset ? (unsigned long long)(fileSize - info->dataOffset) : 0;
+    }
 
-            case 6:
-                playNext(&player);
-                break;
+    unsigned long long frames = dataSize / ((unsigned long long)info->channels * (info->bitsPerSample / 8));
+    return (int)((frames + info->sampleRate / 2) / info->sampleRate);
+}
 
-            case 7:
-                playPrevious(&player);
-                break;
+// Map a raw measurement from its typical range [low, high] onto [-1, 1]
+static float scaleFeature(double value, double low, double high) {
+    double scaled = 2 * (value - low) / (high - low) - 1;
+    return (float)(scaled < -1 ? -1 : (scaled > 1 ? 1 : scaled));
+}
 
-            case 8:
-                peekNext(&player);
-                break;
+// Summarise one fingerprint segment as a 14-bit code
+// Bits 0-11 mark every pitch class at least half as strong as the strongest;
+// bits 12/13 mark a segment clearly louder/quieter than the one before.
+static uint16_t segmentCode(const double* chroma, double rms, double previousRms) {
+    if (rms < SILENCE_RMS) return 0;
 
-            case 9:
-                peekPrevious(&player);
-                break;
+    double strongest = 0;
+    for (int pitch = 0; pitch < 12; pitch++) {
+        if (chroma[pitch] > strongest) strongest = chroma[pitch];
+    }
 
-            case 10:
-                pauseSong(&player);
-                break;
+    uint16_t code = 0;
+    for (int pitch = 0; pitch < 12; pitch++) {
+        if (strongest > 0 && chroma[pitch] * 2 >= strongest) code |= (uint16_t)(1u << pitch);
+    }
+    if (previousRms >= SILENCE_RMS && rms > previousRms * LOUDNESS_STEP) code |= 1u << 12;
+    if (rms * LOUDNESS_STEP < previousRms) code |= 1u << 13;
+    return code;
+}
 
-            case 11:
-                stopSong(&player);
-                break;
+// Extract a compact acoustic fingerprint from a PCM WAV file
+// The first 12 values are a chroma profile (Goertzel energy at every pitch
+// class, folded over four octaves); the last 4 summarise loudness, dynamics,
+// brightness (zero-crossing rate) and harmonic change rate (chroma flux
+// between frames, which follows the pace of the notes), each mapped from its
+// typical range onto [-1, 1] and weighted by TIMBRE_WEIGHT so they count
+// alongside the chroma profile. The fingerprint receives one code per
+// FINGERPRINT_SEGMENT_MS of audio from the first audible frame, and the
+// measured length of the audio is returned through duration.
+int extractAudioFeatures(const char* path, float* features, uint16_t* fingerprint, int* duration) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Could not open '%s'!\n", path);
+        return -1;
+    }
+
+    struct WavInfo info;
+    if (readWavHeader(file, &info) != 0) {
+        printf("'%s' is not a supported PCM WAV file!\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    long fileSize = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (fileSize < 0 || fseek(file, info.dataOffset, SEEK_SET) != 0) {
+        printf("Could not read '%s'!\n", path);
+        fclose(file);
+        return -1;
+    }
+    *duration = wavDuration(&info, fileSize);
+
+    int bytesPerSample = info.bitsPerSample / 8;
+    int frameBytes = bytesPerSample * info.channels;
+    unsigned char* raw = (unsigned char*)malloc((size_t)ANALYSIS_FRAME * frameBytes);
+    float* samples = (float*)malloc(ANALYSIS_FRAME * sizeof(float));
+    if (raw == NULL || samples == NULL) {
+        printf("Memory allocation failed!\n");
+        free(raw);
+        free(samples);
+        fclose(file);
+        return -1;
+    }
+
+    // Goertzel coefficients for every pitch from C3 upwards
+    float coeffs[12 * CHROMA_OCTAVES];
+    for (int octave = 0; octave < CHROMA_OCTAVES; octave++) {
+        for (int pitch = 0; pitch < 12; pitch++) {
+            double freq = 130.8128 * pow(2.0, octave + pitch / 12.0);
+            coeffs[octave * 12 + pitch] = (float)(2.0 * cos(2.0 * PI * freq / info.sampleRate));
+        }
+    }
+
+    double chroma[12] = {0};
+    double rmsSum = 0, rmsSquareSum = 0, zcrSum = 0, fluxSum = 0;
+    double prevChroma[12] = {0};
+    double segmentChroma[12] = {0};
+    double segmentRms = 0, previousSegmentRms = 0;
+    int segment = 0, segmentFrames = 0, audible = -1;
+    unsigned long remaining = info.dataSize / frameBytes;
+    long maxFrames = (long)MAX_ANALYSIS_SECONDS * info.sampleRate / ANALYSIS_FRAME;
+    int frames = 0;
+
+    memset(fingerprint, 0, FINGERPRINT_SEGMENTS * sizeof(uint16_t));
+
+    while (frames < maxFrames && remaining >= ANALYSIS_FRAME) {
+        if (fread(raw, frameBytes, ANALYSIS_FRAME, file) != ANALYSIS_FRAME) break;
+        remaining -= ANALYSIS_FRAME;
+
+        // Mix down to mono and gather time-domain statistics
+        double energy = 0;
+        int crossings = 0;
+        for (int i = 0; i < ANALYSIS_FRAME; i++) {
+            float value = 0;
+            for (int ch = 0; ch < info.channels; ch++) {
+                value += decodeSample(raw + i * frameBytes + ch * bytesPerSample, bytesPerSample);
+            }
+            value /= info.channels;
+            samples[i] = value;
+            energy += value * value;
+            if (i > 0 && (value >= 0) != (samples[i - 1] >= 0)) crossings++;
+        }
+
+        // Pitch-class energy for this frame, normalised so loud and quiet
+        // passages contribute equally to the profile
+        double frameChroma[12] = {0};
+        double frameTotal = 0;
+        for (int bin = 0; bin < 12 * CHROMA_OCTAVES; bin++) {
+            float coeff = coeffs[bin], s1 = 0, s2 = 0;
+            for (int i = 0; i < ANALYSIS_FRAME; i++) {
+                float s0 = samples[i] + coeff * s1 - s2;
+                s2 = s1;
+                s1 = s0;
+            }
+            double power = (double)s1 * s1 + (double)s2 * s2 - (double)coeff * s1 * s2;
+            frameChroma[bin % 12] += power;
+            frameTotal += power;
+        }
+        if (frameTotal > 0) {
+            for (int pitch = 0; pitch < 12; pitch++) {
+                frameChroma[pitch] /= frameTotal;
+                chroma[pitch] += frameChroma[pitch];
+            }
+        }
+
+        double rms = sqrt(energy / ANALYSIS_FRAME);
+
+        // Time-local codes, aligned to the first audible frame so leading
+        // silence does not shift them
+        if (audible < 0 && rms >= SILENCE_RMS) audible = frames;
+        if (audible >= 0 && segment < FINGERPRINT_SEGMENTS) {
+            int frameSegment = (int)((long long)(frames - audible) * ANALYSIS_FRAME * 1000 /
+                                     ((long long)info.sampleRate * FINGERPRINT_SEGMENT_MS));
+            if (frameSegment != segment && segmentFrames > 0) {
+                fingerprint[segment] = segmentCode(segmentChroma, segmentRms / segmentFrames, previousSegmentRms);
+                previousSegmentRms = segmentRms / segmentFrames;
+                memset(segmentChroma, 0, sizeof(segmentChroma));
+                segmentRms = 0;
+                segmentFrames = 0;
+                segment = frameSegment;
+            }
+            if (segment < FINGERPRINT_SEGMENTS) {
+                for (int pitch = 0; pitch < 12; pitch++) {
+                    segmentChroma[pitch] += frameChroma[pitch];
+                }
+                segmentRms += rms;
+                segmentFrames++;
+            }
+        }
+
+        rmsSum += rms;
+        rmsSquareSum += rms * rms;
+        zcrSum += (double)crossings / ANALYSIS_FRAME;
+        for (int pitch = 0; pitch < 12; pitch++) {
+            if (frames > 0) fluxSum += fabs(frameChroma[pitch] - prevChroma[pitch]);
+            prevChroma[pitch] = frameChroma[pitch];
+        }
+        frames++;
+    }
+
+    free(raw);
+    free(samples);
+    fclose(file);
+
+    if (segmentFrames > 0 && segment < FINGERPRINT_SEGMENTS) {
+        fingerprint[segment] = segmentCode(segmentChroma, segmentRms / segmentFrames, previousSegmentRms);
+    }
+
+    if (frames == 0) {
+        printf("'%s' is too short to analyse!\n", path);
+        return -1;
+    }
+
+    double chromaNorm = 0;
+    for (int pitch = 0; pitch < 12; pitch++) {
+        chromaNorm += chroma[pitch] * chroma[pitch];
+    }
+    chromaNorm = sqrt(chromaNorm);
+    for (int pitch = 0; pitch < 12; pitch++) {
+        features[pitch] = chromaNorm > 0 ? (float)(chroma[pitch] / chromaNorm) : 0.0f;
+    }
+
+    // Timbre in units that do not depend on the sample rate or overall level:
+    // loudness in dBFS, dynamics relative to the mean level, brightness as
+    // zero crossings per second on a log scale, and chroma flux per frame
+    double meanRms = rmsSum / frames;
+    double variance = rmsSquareSum / frames - meanRms * meanRms;
+    double level = meanRms > 1e-6 ? meanRms : 1e-6;
+    double crossingsPerSecond = zcrSum / frames * info.sampleRate;
+    double flux = frames > 1 ? fluxSum / (frames - 1) : 0;
+
+    features[12] = TIMBRE_WEIGHT * scaleFeature(20 * log10(level), -60, 0);
+    features[13] = TIMBRE_WEIGHT * scaleFeature(sqrt(variance > 0 ? variance : 0) / level, 0, 1);
+    features[14] = TIMBRE_WEIGHT * scaleFeature(log2(crossingsPerSecond > 1 ? crossingsPerSecond : 1), log2(200.0), log2(12800.0));
+    features[15] = TIMBRE_WEIGHT * scaleFeature(flux, 0, 1);
+
+    normalizeVector(features);
+    return 0;
+}
+
+// Initialize an empty similarity index
+void initIndex(struct SimilarityIndex* index) {
+    index->vectors = NULL;
+    index->fingerprints = NULL;
+    index->ids = NULL;
+    index->durations = NULL;
+    index->songs = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->table = NULL;
+    index->tableCapacity = 0;
+}
+
+// Release all memory held by the similarity index
+void freeIndex(struct SimilarityIndex* index) {
+    free(index->vectors);
+    free(index->fingerprints);
+    free(index->ids);
+    free(index->durations);
+    free(index->songs);
+    free(index->table);
+    initIndex(index);
+}
+
+static unsigned int indexTableHome(const struct SimilarityIndex* index, int id) {
+    return ((unsigned int)id * 2654435761u) & (index->tableCapacity - 1);
+}
+
+// Refill the ID -> slot table from the slots currently in use
+static void fillIndexTable(struct SimilarityIndex* index) {
+    for (int i = 0; i < index->tableCapacity; i++) {
+        index->table[i] = -1;
+    }
+
+    for (int slot = 0; slot < index->count; slot++) {
+        unsigned int pos = indexTableHome(index, index->ids[slot]);
+        while (index->table[pos] >= 0) pos = (pos + 1) & (index->tableCapacity - 1);
+        index->table[pos] = slot;
+    }
+}
+
+// Find the slot of a song in the index, or -1 if it has not been analysed
+static int findIndexSlot(const struct SimilarityIndex* index, int id) {
+    if (index->tableCapacity == 0) return -1;
+
+    unsigned int pos = indexTableHome(index, id);
+    while (index->table[pos] >= 0) {
+        if (index->ids[index->table[pos]] == id) return index->table[pos];
+        pos = (pos + 1) & (index->tableCapacity - 1);
+    }
+    return -1;
+}
+
+// Remove an ID from the table, shifting later entries of its probe run back
+static void unmapIndexSlot(struct SimilarityIndex* index, int id) {
+    unsigned int mask = index->tableCapacity - 1;
+    unsigned int hole = indexTableHome(index, id);
+
+    while (index->table[hole] >= 0 && index->ids[index->table[hole]] != id) hole = (hole + 1) & mask;
+    if (index->table[hole] < 0) return;
+
+    for (unsigned int pos = (hole + 1) & mask; index->table[pos] >= 0; pos = (pos + 1) & mask) {
+        // An entry may fill the hole unless its home lies between the hole and itself
+        unsigned int home = indexTableHome(index, index->ids[index->table[pos]]);
+        if (((pos - home) & mask) >= ((pos - hole) & mask)) {
+            index->table[hole] = index->table[pos];
+            hole = pos;
+        }
+    }
+    index->table[hole] = -1;
+}
+
+// Add or replace the feature vector of a song
+// Returns 0 on success, -1 if the index could not grow.
+int indexSong(struct SimilarityIndex* index, struct Song* song, int duration, const float* features, const uint16_t* fingerprint) {
+    int slot = findIndexSlot(index, song->id);
+
+    if (slot < 0) {
+        if (index->count == index->capacity) {
+            int capacity = index->capacity == 0 ? 64 : index->capacity * 2;
+            float* vectors = (float*)realloc(index->vectors, (size_t)capacity * FEATURE_DIM * sizeof(float));
+            if (vectors == NULL) return -1;
+            index->vectors = vectors;
+
+            uint16_t* fingerprints = (uint16_t*)realloc(index->fingerprints, (size_t)capacity * FINGERPRINT_SEGMENTS * sizeof(uint16_t));
+            if (fingerprints == NULL) return -1;
+            index->fingerprints = fingerprints;
+
+            int* ids = (int*)realloc(index->ids, capacity * sizeof(int));
+            if (ids == NULL) return -1;
+            index->ids = ids;
+
+            int* durations = (int*)realloc(index->durations, capacity * sizeof(int));
+            if (durations == NULL) return -1;
+            index->durations = durations;
+
+            struct Song** songs = (struct Song**)realloc(index->songs, capacity * sizeof(struct Song*));
+            if (songs == NULL) return -1;
+            index->songs = songs;
+
+            index->capacity = capacity;
+        }
+
+        // Keep the table at most half full
+        if ((index->count + 1) * 2 > index->tableCapacity) {
+            int tableCapacity = index->tableCapacity == 0 ? 1024 : index->tableCapacity * 2;
+            int* table = (int*)malloc(tableCapacity * sizeof(int));
+            if (table == NULL) return -1;
+            free(index->table);
+            index->table = table;
+            index->tableCapacity = tableCapacity;
+            fillIndexTable(index);
+        }
+
+        slot = index->count++;
+        index->ids[slot] = song->id;
+        unsigned int pos = indexTableHome(index, song->id);
+        while (index->table[pos] >= 0) pos = (pos + 1) & (index->tableCapacity - 1);
+        index->table[pos] = slot;
+    }
+
+    memcpy(index->vectors + (size_t)slot * FEATURE_DIM, features, FEATURE_DIM * sizeof(float));
+    memcpy(index->fingerprints + (size_t)slot * FINGERPRINT_SEGMENTS, fingerprint, FINGERPRINT_SEGMENTS * sizeof(uint16_t));
+    index->durations[slot] = duration;
+    index->songs[slot] = song;
+    return 0;
+}
+
+// Remove a song from the index by moving the last entry into its slot
+void removeFromIndex(struct SimilarityIndex* index, int id) {
+    int slot = findIndexSlot(index, id);
+    if (slot < 0) return;
+
+    unmapIndexSlot(index, id);
+    int last = --index->count;
+    if (slot != last) {
+        // Point the moved song's table entry at its new slot
+        unsigned int pos = indexTableHome(index, index->ids[last]);
+        while (index->table[pos] != last) pos = (pos + 1) & (index->tableCapacity - 1);
+        index->table[pos] = slot;
+
+        memcpy(index->vectors + (size_t)slot * FEATURE_DIM,
+               index->vectors + (size_t)last * FEATURE_DIM,
+               FEATURE_DIM * sizeof(float));
+        memcpy(index->fingerprints + (size_t)slot * FINGERPRINT_SEGMENTS,
+               index->fingerprints + (size_t)last * FINGERPRINT_SEGMENTS,
+               FINGERPRINT_SEGMENTS * sizeof(uint16_t));
+        index->ids[slot] = index->ids[last];
+        index->durations[slot] = index->durations[last];
+        index->songs[slot] = index->songs[last];
+    }
+}
+
+// Score a block of contiguous vectors against the query (dot products)
+static void scoreBlock(const float* vectors, int count, const float* query, float* scores) {
+#ifdef USE_SSE
+    // Keep the whole query in registers; each vector is four multiply-adds
+    __m128 q0 = _mm_loadu_ps(query);
+    __m128 q1 = _mm_loadu_ps(query + 4);
+    __m128 q2 = _mm_loadu_ps(query + 8);
+    __m128 q3 = _mm_loadu_ps(query + 12);
+
+    for (int i = 0; i < count; i++) {
+        const float* v = vectors + (size_t)i * FEATURE_DIM;
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(v), q0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(v + 4), q1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(v + 8), q2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(v + 12), q3));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        scores[i] = _mm_cvtss_f32(sum);
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        const float* v = vectors + (size_t)i * FEATURE_DIM;
+        float sum = 0;
+        for (int d = 0; d < FEATURE_DIM; d++) {
+            sum += v[d] * query[d];
+        }
+        scores[i] = sum;
+    }
+#endif
+}
+
+// Find the k songs whose vectors are closest to the query
+// Results are written best-first; returns how many were found.
+int findSimilarSongs(struct SimilarityIndex* index, const float* query, int k, int excludeId, int* outIds, float* outScores) {
+    float scores[SCORE_BLOCK];
+    int found = 0;
+
+    if (k < 1) return 0;
+
+    for (int start = 0; start < index->count; start += SCORE_BLOCK) {
+        int count = index->count - start < SCORE_BLOCK ? index->count - start : SCORE_BLOCK;
+        scoreBlock(index->vectors + (size_t)start * FEATURE_DIM, count, query, scores);
+
+        // Insertion into the small sorted top-k list
+        for (int i = 0; i < count; i++) {
+            int id = index->ids[start + i];
+            if (id == excludeId) continue;
+            if (found == k && scores[i] <= outScores[k - 1]) continue;
+
+            int pos = found < k ? found++ : k - 1;
+            while (pos > 0 && outScores[pos - 1] < scores[i]) {
+                outScores[pos] = outScores[pos - 1];
+                outIds[pos] = outIds[pos - 1];
+                pos--;
+            }
+            outScores[pos] = scores[i];
+            outIds[pos] = id;
+        }
+    }
+
+    return found;
+}
+
+static int countBits(unsigned int value) {
+    int count = 0;
+    for (; value != 0; value &= value - 1) count++;
+    return count;
+}
+
+// Fraction of code bits two fingerprints differ in, at their best alignment
+// Segments are compared in order, so songs with the same overall harmony but
+// different melodies or rhythms still differ. Returns 1 if there is too
+// little audio in common to tell.
+static float fingerprintDistance(const uint16_t* a, const uint16_t* b) {
+    float best = 1.0f;
+
+    for (int shift = -FINGERPRINT_MAX_SHIFT; shift <= FINGERPRINT_MAX_SHIFT; shift++) {
+        int differing = 0, total = 0;
+        for (int i = 0; i < FINGERPRINT_SEGMENTS; i++) {
+            int j = i + shift;
+            if (j < 0 || j >= FINGERPRINT_SEGMENTS) continue;
+            total += countBits(a[i] | b[j]);
+            differing += countBits(a[i] ^ b[j]);
+        }
+        if (total >= DUPLICATE_MIN_BITS && (float)differing / total < best) {
+            best = (float)differing / total;
+        }
+    }
+
+    return best;
+}
+
+// Analyse a song's audio file and store its fingerprint in the index
+void analyzeSongAudio(struct MusicPlayer* player, int id, const char* path) {
+    struct Song* temp = player->head;
+
+    while (temp != NULL && temp->id != id) {
+        temp = temp->next;
+    }
+
+    if (temp == NULL) {
+        printf("Song with ID %d not found!\n", id);
+        return;
+    }
+
+    float features[FEATURE_DIM];
+    uint16_t fingerprint[FINGERPRINT_SEGMENTS];
+    int duration;
+    if (extractAudioFeatures(path, features, fingerprint, &duration) != 0) return;
+
+    if (indexSong(&player->similar, temp, duration, features, fingerprint) != 0) {
+        printf("Memory allocation failed!\n");
+        return;
+    }
+
+    printf("Song '%s' analysed and added to the similarity index!\n", temp->title);
+}
+
+// Play the analysed song that sounds most like the current one
+void playSimilarNext(struct MusicPlayer* player) {
+    STATS_START(OP_PLAY_SIMILAR);
+
+    if (player->current == NULL) {
+        printf("No current song!\n");
+        STATS_STOP(OP_PLAY_SIMILAR);
+        return;
+    }
+
+    int slot = findIndexSlot(&player->similar, player->current->id);
+    if (slot < 0) {
+        printf("Song '%s' has not been analysed yet!\n", player->current->title);
+        STATS_STOP(OP_PLAY_SIMILAR);
+        return;
+    }
+
+    int ids[SIMILAR_CANDIDATES];
+    float scores[SIMILAR_CANDIDATES];
+    int found = findSimilarSongs(&player->similar,
+                                 player->similar.vectors + (size_t)slot * FEATURE_DIM,
+                                 SIMILAR_CANDIDATES, player->current->id, ids, scores);
+    const uint16_t* fingerprint = player->similar.fingerprints + (size_t)slot * FINGERPRINT_SEGMENTS;
+
+    for (int i = 0; i < found; i++) {
+        // Another copy of the same recording is not a useful suggestion
+        int candidate = findIndexSlot(&player->similar, ids[i]);
+        if (fingerprintDistance(fingerprint, player->similar.fingerprints +
+                                (size_t)candidate * FINGERPRINT_SEGMENTS) <= DUPLICATE_MAX_DISTANCE) {
+            continue;
+        }
+
+        printf("Most similar song (similarity %.3f):\n", scores[i]);
+        player->current = player->similar.songs[candidate];
+        startPlayback(player);
+        STATS_STOP(OP_PLAY_SIMILAR);
+        return;
+    }
+
+    printf("No similar songs found!\n");
+    STATS_STOP(OP_PLAY_SIMILAR);
+}
+
+// Comparator context for sorting index slots by duration
+static const struct SimilarityIndex* sortIndex;
+
+static int compareByDuration(const void* a, const void* b) {
+    int left = sortIndex->durations[*(const int*)a];
+    int right = sortIndex->durations[*(const int*)b];
+    return (left > right) - (left < right);
+}
+
+// Report pairs of analysed songs that are probably the same recording
+// Vectors are copied into duration order so each song is block-scored
+// against the songs no more than DUPLICATE_DURATION_SLACK longer; pairs
+// whose overall profiles match are then confirmed segment by segment.
+void findNearDuplicates(struct MusicPlayer* player) {
+    struct SimilarityIndex* index = &player->similar;
+    int count = index->count;
+
+    if (count < 2) {
+        printf("Need at least 2 analysed songs to compare!\n");
+        return;
+    }
+
+    int* order = (int*)malloc(count * sizeof(int));
+    float* sorted = (float*)malloc((size_t)count * FEATURE_DIM * sizeof(float));
+    if (order == NULL || sorted == NULL) {
+        printf("Memory allocation failed!\n");
+        free(order);
+        free(sorted);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    sortIndex = index;
+    qsort(order, count, sizeof(int), compareByDuration);
+
+    for (int i = 0; i < count; i++) {
+        memcpy(sorted + (size_t)i * FEATURE_DIM, index->vectors + (size_t)order[i] * FEATURE_DIM,
+               FEATURE_DIM * sizeof(float));
+    }
+
+    float scores[SCORE_BLOCK];
+    int pairs = 0;
+    int windowEnd = 0;
+    printf("Near-duplicate recordings:\n");
+
+    for (int i = 0; i < count; i++) {
+        const float* query = sorted + (size_t)i * FEATURE_DIM;
+        int duration = index->durations[order[i]];
+
+        if (windowEnd <= i) windowEnd = i + 1;
+        while (windowEnd < count && index->durations[order[windowEnd]] - duration <= DUPLICATE_DURATION_SLACK) {
+            windowEnd++;
+        }
+
+        for (int start = i + 1; start < windowEnd; start += SCORE_BLOCK) {
+            int block = windowEnd - start < SCORE_BLOCK ? windowEnd - start : SCORE_BLOCK;
+            scoreBlock(sorted + (size_t)start * FEATURE_DIM, block, query, scores);
+
+            for (int j = 0; j < block; j++) {
+                if (scores[j] < DUPLICATE_PREFILTER) continue;
+
+                float distance = fingerprintDistance(index->fingerprints + (size_t)order[i] * FINGERPRINT_SEGMENTS,
+                                                     index->fingerprints + (size_t)order[start + j] * FINGERPRINT_SEGMENTS);
+                if (distance <= DUPLICATE_MAX_DISTANCE) {
+                    printf("- ID %d and ID %d (%.0f%% of fingerprint bits match)\n",
+                           index->ids[order[i]], index->ids[order[start + j]], 100 * (1 - distance));
+                    pairs++;
+                }
+            }
+        }
+    }
+
+    free(order);
+    free(sorted);
+
+    if (pairs == 0) {
+        printf("No near-duplicates found!\n");
+    } else {
+        printf("Found %d near-duplicate pair(s)\n", pairs);
+    }
+}
+
+// Check whether an ID is in the set
+static int idSetContains(const struct IdSet* set, int id) {
+    if (set->capacity == 0) return 0;
+
+    unsigned int pos = ((unsigned int)id * 2654435761u) & (set->capacity - 1);
+    while (set->slots[pos] != 0) {
+        if (set->slots[pos] == id) return 1;
+        pos = (pos + 1) & (set->capacity - 1);
+    }
+    return 0;
+}
+
+static void freeIdSet(struct IdSet* set) {
+    free(set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
+
+// Drop every song in the set from the similarity index in one pass
+void removeIdsFromIndex(struct SimilarityIndex* index, const struct IdSet* ids) {
+    int kept = 0;
+
+    if (ids->count == 0) return;
+
+    for (int i = 0; i < index->count; i++) {
+        if (idSetContains(ids, index->ids[i])) continue;
+        if (kept != i) {
+            memcpy(index->vectors + (size_t)kept * FEATURE_DIM,
+                   index->vectors + (size_t)i * FEATURE_DIM,
+                   FEATURE_DIM * sizeof(float));
+            memcpy(index->fingerprints + (size_t)kept * FINGERPRINT_SEGMENTS,
+                   index->fingerprints + (size_t)i * FINGERPRINT_SEGMENTS,
+                   FINGERPRINT_SEGMENTS * sizeof(uint16_t));
+            index->ids[kept] = index->ids[i];
+            index->durations[kept] = index->durations[i];
+            index->songs[kept] = index->songs[i];
+        }
+        kept++;
+    }
+
+    if (kept != index->count) {
+        index->count = kept;
+        fillIndexTable(index);
+    }
+}
+
+// Initialize an empty library cache
+void initLibraryCache(struct LibraryCache* cache) {
+    cache->entries = NULL;
+    cache->capacity = 0;
+    cache->count = 0;
+    cache->generation = 0;
+    cache->ids.slots = NULL;
+    cache->ids.capacity = 0;
+    cache->ids.count = 0;
+}
+
+// Release all memory held by the library cache
+void freeLibraryCache(struct LibraryCache* cache) {
+    for (int i = 0; i < cache->capacity; i++) {
+        free(cache->entries[i].path);
+    }
+    free(cache->entries);
+    freeIdSet(&cache->ids);
+    initLibraryCache(cache);
+}
+
+#ifndef _WIN32
+// FNV-1a hash, used both for content IDs and for path lookups
+static unsigned int hashBytes(unsigned int hash, const unsigned char* bytes, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static unsigned int hashString(const char* text) {
+    return hashBytes(2166136261u, (const unsigned char*)text, strlen(text));
+}
+
+static unsigned long long hashBytes64(unsigned long long hash, const unsigned char* bytes, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 64-bit content hash of `length` bytes of audio starting at `offset`
+// Blocks from the start, middle and end are hashed together with the length,
+// so files that share an opening (or open with silence) still differ.
+static unsigned long long hashAudio(FILE* file, long long offset, long long length) {
+    unsigned char sample[HASH_SAMPLE_BYTES];
+    unsigned long long hash = hashBytes64(14695981039346656037ULL, (const unsigned char*)&length, sizeof(length));
+    long long starts[3] = {0, (length - HASH_SAMPLE_BYTES) / 2, length - HASH_SAMPLE_BYTES};
+
+    for (int i = 0; i < 3; i++) {
+        long long start = starts[i] > 0 ? starts[i] : 0;
+        if (start >= length || fseek(file, (long)(offset + start), SEEK_SET) != 0) break;
+
+        size_t wanted = length - start < (long long)sizeof(sample) ? (size_t)(length - start) : sizeof(sample);
+        hash = hashBytes64(hash, sample, fread(sample, 1, wanted, file));
+    }
+    return hash;
+}
+
+// Add an ID to the set, growing it when half full
+// Returns 0 on success, -1 if the set could not grow.
+static int idSetInsert(struct IdSet* set, int id) {
+    if ((set->count + 1) * 2 > set->capacity) {
+        int capacity = set->capacity == 0 ? 1024 : set->capacity * 2;
+        int* slots = (int*)calloc(capacity, sizeof(int));
+        if (slots == NULL) return -1;
+
+        for (int i = 0; i < set->capacity; i++) {
+            if (set->slots[i] == 0) continue;
+            unsigned int pos = ((unsigned int)set->slots[i] * 2654435761u) & (capacity - 1);
+            while (slots[pos] != 0) pos = (pos + 1) & (capacity - 1);
+            slots[pos] = set->slots[i];
+        }
+
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+
+    unsigned int pos = ((unsigned int)id * 2654435761u) & (set->capacity - 1);
+    while (set->slots[pos] != 0) {
+        if (set->slots[pos] == id) return 0;
+        pos = (pos + 1) & (set->capacity - 1);
+    }
+    set->slots[pos] = id;
+    set->count++;
+    return 0;
+}
+
+// Build an ID -> node map of the whole playlist in one pass
+// Returns 0 on success, -1 on allocation failure.
+static int buildSongMap(struct SongMap* map, struct MusicPlayer* player) {
+    int capacity = 1024;
+    while (capacity < player->totalSongs * 2) capacity *= 2;
+
+    map->slots = (struct Song**)calloc(capacity, sizeof(struct Song*));
+    if (map->slots == NULL) return -1;
+    map->capacity = capacity;
+
+    for (struct Song* temp = player->head; temp != NULL; temp = temp->next) {
+        unsigned int pos = ((unsigned int)temp->id * 2654435761u) & (capacity - 1);
+        while (map->slots[pos] != NULL && map->slots[pos]->id != temp->id) pos = (pos + 1) & (capacity - 1);
+        if (map->slots[pos] == NULL) map->slots[pos] = temp; // first node wins for repeated IDs
+    }
+    return 0;
+}
+
+static struct Song* findMappedSong(const struct SongMap* map, int id) {
+    unsigned int pos = ((unsigned int)id * 2654435761u) & (map->capacity - 1);
+    while (map->slots[pos] != NULL) {
+        if (map->slots[pos]->id == id) return map->slots[pos];
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+// Look up the cache entry for a file path, or NULL if it was never scanned
+static struct LibraryEntry* findLibraryEntry(struct LibraryCache* cache, const char* path) {
+    if (cache->capacity == 0) return NULL;
+
+    unsigned int pos = hashString(path) & (cache->capacity - 1);
+    while (cache->entries[pos].path != NULL) {
+        if (strcmp(cache->entries[pos].path, path) == 0) return &cache->entries[pos];
+        pos = (pos + 1) & (cache->capacity - 1);
+    }
+    return NULL;
+}
+
+// Grow the cache so that `extra` more entries fit without rehashing
+// Entry pointers stay valid until the next call.
+static int reserveLibraryCache(struct LibraryCache* cache, int extra) {
+    int capacity = cache->capacity == 0 ? 1024 : cache->capacity;
+    while ((cache->count + extra) * 2 > capacity) capacity *= 2;
+    if (capacity == cache->capacity) return 0;
+
+    struct LibraryEntry* entries = (struct LibraryEntry*)calloc(capacity, sizeof(struct LibraryEntry));
+    if (entries == NULL) return -1;
+
+    for (int i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].path == NULL) continue;
+        unsigned int pos = hashString(cache->entries[i].path) & (capacity - 1);
+        while (entries[pos].path != NULL) pos = (pos + 1) & (capacity - 1);
+        entries[pos] = cache->entries[i];
+    }
+
+    free(cache->entries);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return 0;
+}
+
+// Insert a new path into a cache that has already been reserved
+static struct LibraryEntry* insertLibraryEntry(struct LibraryCache* cache, const char* path) {
+    unsigned int pos = hashString(path) & (cache->capacity - 1);
+    while (cache->entries[pos].path != NULL) pos = (pos + 1) & (cache->capacity - 1);
+
+    struct LibraryEntry* entry = &cache->entries[pos];
+    entry->path = strdup(path);
+    if (entry->path == NULL) return NULL;
+    entry->present = 0;
+    cache->count++;
+    return entry;
+}
+
+// Turn a content hash into a positive song ID that no other song uses
+// Identical recordings hash alike, so clashes probe to the next free ID.
+static int assignLibraryId(struct LibraryCache* cache, const struct SongMap* live, unsigned long long hash) {
+    int id = (int)((hash ^ (hash >> 32)) & 0x7FFFFFFFu);
+    if (id == 0) id = 1;
+
+    while (idSetContains(&cache->ids, id) || findMappedSong(live, id) != NULL) {
+        id = id == 0x7FFFFFFF ? 1 : id + 1;
+    }
+
+    if (idSetInsert(&cache->ids, id) != 0) return -1;
+    return id;
+}
+
+// Copy an ID3/RIFF text field into a NUL-terminated song field
+// encoding: 0 = ISO-8859-1, 1 = UTF-16 with BOM, 2 = UTF-16BE, 3 = UTF-8.
+// Non-ASCII UTF-16 characters are replaced with '?'.
+static void copyTagText(char* dest, const unsigned char* src, size_t length, int encoding) {
+    size_t out = 0;
+
+    if (encoding == 1 || encoding == 2) {
+        int bigEndian = encoding == 2;
+        size_t i = 0;
+        if (length >= 2 && ((src[0] == 0xFF && src[1] == 0xFE) || (src[0] == 0xFE && src[1] == 0xFF))) {
+            bigEndian = src[0] == 0xFE;
+            i = 2;
+        }
+        for (; i + 1 < length && out < 99; i += 2) {
+            unsigned int unit = bigEndian ? (src[i] << 8) | src[i + 1] : src[i] | (src[i + 1] << 8);
+            if (unit == 0) break;
+            dest[out++] = unit < 0x80 ? (char)unit : '?';
+        }
+    } else {
+        for (size_t i = 0; i < length && src[i] != 0 && out < 99; i++) {
+            dest[out++] = (char)src[i];
+        }
+    }
+
+    while (out > 0 && (dest[out - 1] == ' ' || dest[out - 1] == '\r' || dest[out - 1] == '\n')) out--;
+    dest[out] = 0;
+}
+
+// Read the title/artist/album of a RIFF LIST/INFO chunk
+static void readWavInfoList(FILE* file, unsigned long size, struct SongTags* tags) {
+    unsigned char list[4096];
+    size_t length = size < sizeof(list) ? size : sizeof(list);
+
+    if (fread(list, 1, length, file) != length || length < 4 || memcmp(list, "INFO", 4) != 0) return;
+
+    size_t pos = 4;
+    while (pos + 8 <= length) {
+        unsigned long fieldSize = readLE32(list + pos + 4);
+        const unsigned char* text = list + pos + 8;
+        size_t available = length - pos - 8;
+        size_t textLength = fieldSize < available ? fieldSize : available;
+
+        if (memcmp(list + pos, "INAM", 4) == 0 && tags->title[0] == 0) {
+            copyTagText(tags->title, text, textLength, 0);
+        } else if (memcmp(list + pos, "IART", 4) == 0 && tags->artist[0] == 0) {
+            copyTagText(tags->artist, text, textLength, 0);
+        } else if (memcmp(list + pos, "IPRD", 4) == 0 && tags->album[0] == 0) {
+            copyTagText(tags->album, text, textLength, 0);
+        }
+
+        pos += 8 + fieldSize + (fieldSize & 1);
+    }
+}
+
+// Fill tags from a WAV file: exact duration from the format chunk, text from LIST/INFO
+static int readWavTags(FILE* file, long long fileSize, struct SongTags* tags, unsigned long long* hash) {
+    struct WavInfo info;
+    unsigned char chunk[8];
+
+    if (readWavHeader(file, &info) != 0) return -1;
+
+    unsigned long long dataSize = info.dataSize;
+    if ((long long)(info.dataOffset + dataSize) > fileSize) {
+        dataSize = (unsigned long long)(fileSize - info.dataOffset); // streamed or truncated file
+    }
+    tags->duration = wavDuration(&info, fileSize);
+
+    *hash = hashAudio(file, info.dataOffset, (long long)dataSize);
+
+    // LIST/INFO may sit before or after the sample data, so walk every chunk
+    if (fseek(file, 12, SEEK_SET) != 0) return 0;
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk)) {
+        unsigned long size = readLE32(chunk + 4);
+        long next = ftell(file) + (long)(size + (size & 1));
+
+        if (memcmp(chunk, "LIST", 4) == 0) {
+            readWavInfoList(file, size, tags);
+        }
+        if (next >= fileSize || fseek(file, next, SEEK_SET) != 0) break;
+    }
+
+    return 0;
+}
+
+// Parse an MPEG audio frame header
+// Returns 0 and fills the frame description if the four bytes are valid.
+static int parseMpegHeader(const unsigned char* header, struct MpegFrame* frame) {
+    static const int bitrates[5][15] = {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448}, // MPEG1 layer I
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},    // MPEG1 layer II
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},     // MPEG1 layer III
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},    // MPEG2/2.5 layer I
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}          // MPEG2/2.5 layer II/III
+    };
+    static const int sampleRates[3] = {44100, 48000, 32000};
+
+    if (header[0] != 0xFF || (header[1] & 0xE0) != 0xE0) return -1;
+
+    int version = (header[1] >> 3) & 3; // 0 = 2.5, 2 = 2, 3 = 1
+    int layer = 4 - ((header[1] >> 1) & 3);
+    int bitrateIndex = header[2] >> 4;
+    int rateIndex = (header[2] >> 2) & 3;
+    if (version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) return -1;
+
+    int mpeg1 = version == 3;
+    frame->bitrate = bitrates[mpeg1 ? layer - 1 : (layer == 1 ? 3 : 4)][bitrateIndex] * 1000;
+    frame->sampleRate = sampleRates[rateIndex] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+    frame->samplesPerFrame = layer == 1 ? 384 : (layer == 3 && !mpeg1 ? 576 : 1152);
+    frame->sideInfo = mpeg1 ? ((header[3] >> 6) == 3 ? 17 : 32) : ((header[3] >> 6) == 3 ? 9 : 17);
+    return 0;
+}
+
+// Fill tags from an MP3 file: ID3v2 (falling back to ID3v1) for text,
+// Xing/Info/VBRI frame counts for an exact duration, bitrate for plain CBR.
+static int readMp3Tags(FILE* file, long long fileSize, struct SongTags* tags, unsigned long long* hash) {
+    unsigned char header[10];
+    long long audioStart = 0;
+
+    if (fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, "ID3", 3) == 0) {
+        int major = header[3];
+        long tagSize = (header[6] << 21) | (header[7] << 14) | (header[8] << 7) | header[9];
+        long pos = 10;
+        long end = 10 + tagSize;
+        int frameHeaderSize = major == 2 ? 6 : 10;
+
+        audioStart = end + ((header[5] & 0x10) ? 10 : 0);
+
+        if ((header[5] & 0x40) && major >= 3) {
+            unsigned char extended[4];
+            if (fread(extended, 1, 4, file) == 4) {
+                long size = major == 4
+                    ? (extended[0] << 21) | (extended[1] << 14) | (extended[2] << 7) | extended[3]
+                    : (long)(((unsigned long)extended[0] << 24) | (extended[1] << 16) | (extended[2] << 8) | extended[3]) + 4;
+                pos += size;
+            }
+        }
+
+        while (pos + frameHeaderSize <= end && fseek(file, pos, SEEK_SET) == 0) {
+            unsigned char frameHeader[10];
+            if (fread(frameHeader, 1, frameHeaderSize, file) != (size_t)frameHeaderSize || frameHeader[0] == 0) break;
+
+            long size;
+            char* dest = NULL;
+            if (major == 2) {
+                size = (frameHeader[3] << 16) | (frameHeader[4] << 8) | frameHeader[5];
+                if (memcmp(frameHeader, "TT2", 3) == 0) dest = tags->title;
+                else if (memcmp(frameHeader, "TP1", 3) == 0) dest = tags->artist;
+                else if (memcmp(frameHeader, "TAL", 3) == 0) dest = tags->album;
+            } else {
+                size = major == 4
+                    ? (frameHeader[4] << 21) | (frameHeader[5] << 14) | (frameHeader[6] << 7) | frameHeader[7]
+                    : (long)(((unsigned long)frameHeader[4] << 24) | (frameHeader[5] << 16) | (frameHeader[6] << 8) | frameHeader[7]);
+                if (memcmp(frameHeader, "TIT2", 4) == 0) dest = tags->title;
+                else if (memcmp(frameHeader, "TPE1", 4) == 0) dest = tags->artist;
+                else if (memcmp(frameHeader, "TALB", 4) == 0) dest = tags->album;
+            }
+            if (size <= 0) break;
+
+            if (dest != NULL && dest[0] == 0) {
+                unsigned char text[512];
+                size_t length = size < (long)sizeof(text) ? (size_t)size : sizeof(text);
+                if (fread(text, 1, length, file) == length) {
+                    copyTagText(dest, text + 1, length - 1, text[0]);
+                }
+            }
+
+            pos += frameHeaderSize + size;
+        }
+    }
+
+    // ID3v1 sits in the last 128 bytes
+    int hasId3v1 = 0;
+    unsigned char trailer[128];
+    if (fileSize >= 128 && fseek(file, (long)(fileSize - 128), SEEK_SET) == 0 &&
+        fread(trailer, 1, sizeof(trailer), file) == sizeof(trailer) && memcmp(trailer, "TAG", 3) == 0) {
+        hasId3v1 = 1;
+        if (tags->title[0] == 0) copyTagText(tags->title, trailer + 3, 30, 0);
+        if (tags->artist[0] == 0) copyTagText(tags->artist, trailer + 33, 30, 0);
+        if (tags->album[0] == 0) copyTagText(tags->album, trailer + 63, 30, 0);
+    }
+
+    // Find the first audio frame
+    unsigned char audio[HASH_SAMPLE_BYTES];
+    if (fseek(file, (long)audioStart, SEEK_SET) != 0) return -1;
+    size_t length = fread(audio, 1, sizeof(audio), file);
+    struct MpegFrame frame;
+    size_t start = 0;
+    while (start + 4 <= length && parseMpegHeader(audio + start, &frame) != 0) start++;
+    if (start + 4 > length) return -1;
+
+    long long audioBytes = fileSize - audioStart - (long long)start - (hasId3v1 ? 128 : 0);
+    unsigned long frameCount = 0;
+    size_t xing = start + 4 + frame.sideInfo;
+    size_t vbri = start + 36;
+
+    if (xing + 12 <= length && (memcmp(audio + xing, "Xing", 4) == 0 || memcmp(audio + xing, "Info", 4) == 0) &&
+        (audio[xing + 7] & 1)) {
+        frameCount = ((unsigned long)audio[xing + 8] << 24) | (audio[xing + 9] << 16) | (audio[xing + 10] << 8) | audio[xing + 11];
+    } else if (vbri + 18 <= length && memcmp(audio + vbri, "VBRI", 4) == 0) {
+        frameCount = ((unsigned long)audio[vbri + 14] << 24) | (audio[vbri + 15] << 16) | (audio[vbri + 16] << 8) | audio[vbri + 17];
+    }
+
+    if (frameCount > 0) {
+        tags->duration = (int)(((unsigned long long)frameCount * frame.samplesPerFrame + frame.sampleRate / 2) / frame.sampleRate);
+    } else {
+        tags->duration = (int)((audioBytes * 8 + frame.bitrate / 2) / frame.bitrate);
+    }
+
+    *hash = hashAudio(file, audioStart + (long long)start, audioBytes);
+    return 0;
+}
+
+// Check the file extension against the formats the scanner understands
+static int isAudioFile(const char* name) {
+    const char* dot = strrchr(name, '.');
+    if (dot == NULL) return 0;
+
+    char ext[5] = {0};
+    for (int i = 0; i < 4 && dot[i + 1] != 0; i++) {
+        ext[i] = (char)tolower((unsigned char)dot[i + 1]);
+    }
+    return strcmp(ext, "wav") == 0 || strcmp(ext, "mp3") == 0;
+}
+
+// Read the song fields of one audio file from its header bytes
+// Missing text tags fall back to the file name and "Unknown".
+int readSongTags(const char* path, long long fileSize, struct SongTags* tags, unsigned long long* hash) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return -1;
+
+    memset(tags, 0, sizeof(*tags));
+    const char* dot = strrchr(path, '.');
+    int result = tolower((unsigned char)dot[1]) == 'w'
+        ? readWavTags(file, fileSize, tags, hash)
+        : readMp3Tags(file, fileSize, tags, hash);
+    fclose(file);
+    if (result != 0) return -1;
+
+    if (tags->title[0] == 0) {
+        const char* name = strrchr(path, '/');
+        name = name == NULL ? path : name + 1;
+        size_t length = (size_t)(dot - name) < 99 ? (size_t)(dot - name) : 99;
+        memcpy(tags->title, name, length);
+        tags->title[length] = 0;
+    }
+    if (tags->artist[0] == 0) strcpy(tags->artist, "Unknown Artist");
+    if (tags->album[0] == 0) strcpy(tags->album, "Unknown Album");
+    return 0;
+}
+
+// Recursively gather the audio files below a folder into the scan queue
+// Returns 0 on success, -1 on allocation failure, -2 if the folder cannot be opened.
+static int collectFiles(const char* folder, struct ScanQueue* queue, int* capacity, int depth) {
+    DIR* dir = opendir(folder);
+    if (dir == NULL) return -2;
+
+    struct dirent* item;
+    char path[MAX_PATH_LENGTH];
+
+    while ((item = readdir(dir)) != NULL) {
+        if (item->d_name[0] == '.') continue; // ".", ".." and hidden files
+
+        if (snprintf(path, sizeof(path), "%s/%s", folder, item->d_name) >= (int)sizeof(path)) continue;
+
+        int isFolder;
+#ifdef DT_DIR
+        if (item->d_type != DT_UNKNOWN && item->d_type != DT_LNK) {
+            isFolder = item->d_type == DT_DIR;
+        } else
+#endif
+        {
+            struct stat info;
+            isFolder = stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+        }
+
+        if (isFolder) {
+            if (depth < MAX_SCAN_DEPTH && collectFiles(path, queue, capacity, depth + 1) == -1) {
+                closedir(dir);
+                return -1;
+            }
+        } else if (isAudioFile(item->d_name)) {
+            if (queue->count == *capacity) {
+                int grown = *capacity == 0 ? 1024 : *capacity * 2;
+                struct ScanJob* jobs = (struct ScanJob*)realloc(queue->jobs, grown * sizeof(struct ScanJob));
+                if (jobs == NULL) {
+                    closedir(dir);
+                    return -1;
+                }
+                queue->jobs = jobs;
+                *capacity = grown;
+            }
+
+            struct ScanJob* job = &queue->jobs[queue->count];
+            memset(job, 0, sizeof(*job));
+            job->path = strdup(path);
+            if (job->path == NULL) {
+                closedir(dir);
+                return -1;
+            }
+            queue->count++;
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+// Stat one file and read its header unless the cache says it is unchanged
+static void scanFile(struct ScanJob* job) {
+    struct stat info;
+    struct LibraryEntry* cached = job->cached;
+
+    job->status = SCAN_FAILED;
+    if (stat(job->path, &info) != 0 || !S_ISREG(info.st_mode)) return;
+
+    job->mtime = (long long)info.st_mtime;
+    job->size = (long long)info.st_size;
+
+    if (cached != NULL && cached->present && cached->mtime == job->mtime && cached->size == job->size) {
+        job->status = SCAN_UNCHANGED;
+        return;
+    }
+
+    job->tags = (struct SongTags*)malloc(sizeof(struct SongTags));
+    if (job->tags == NULL) return;
+
+    if (readSongTags(job->path, job->size, job->tags, &job->hash) != 0) {
+        free(job->tags);
+        job->tags = NULL;
+        return;
+    }
+    job->status = SCAN_READ;
+}
+
+// Worker thread: claim chunks of the queue until it is exhausted
+static void* scanWorker(void* arg) {
+    struct ScanQueue* queue = (struct ScanQueue*)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        int start = queue->next;
+        queue->next += SCAN_CHUNK;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (start >= queue->count) break;
+        int end = start + SCAN_CHUNK < queue->count ? start + SCAN_CHUNK : queue->count;
+        for (int i = start; i < end; i++) {
+            scanFile(&queue->jobs[i]);
+        }
+    }
+
+    return NULL;
+}
+
+static int compareJobPaths(const void* a, const void* b) {
+    return strcmp(((const struct ScanJob*)a)->path, ((const struct ScanJob*)b)->path);
+}
+
+static int compareEntryHashes(const void* a, const void* b) {
+    unsigned long long left = (*(struct LibraryEntry* const*)a)->hash;
+    unsigned long long right = (*(struct LibraryEntry* const*)b)->hash;
+    return (left > right) - (left < right);
+}
+
+// Find an unclaimed vanished entry with the given content hash
+static struct LibraryEntry* claimVanishedEntry(struct LibraryEntry** vanished, int count, unsigned long long hash) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (vanished[mid]->hash < hash) low = mid + 1;
+        else high = mid;
+    }
+
+    for (; low < count && vanished[low]->hash == hash; low++) {
+        if (vanished[low]->id > 0) return vanished[low];
+    }
+    return NULL;
+}
+
+// Copy freshly read tags onto an existing playlist node
+static void updateSongFromTags(struct Song* song, const struct SongTags* tags) {
+    strcpy(song->title, tags->title);
+    strcpy(song->artist, tags->artist);
+    strcpy(song->album, tags->album);
+    song->duration = tags->duration;
+}
+
+// Scan a music folder and add its WAV/MP3 files to the playlist
+// Files are read by several threads; a rescan only re-reads files whose
+// mtime or size changed, keeps the ID of a file that was moved or renamed
+// (matched by content hash) and removes songs whose files disappeared.
+void scanLibrary(struct MusicPlayer* player, const char* folder) {
+    struct LibraryCache* cache = &player->library;
+    struct ScanQueue queue;
+    struct SongMap live = {NULL, 0};
+    struct IdSet staleVectors = {NULL, 0, 0};
+    struct LibraryEntry** vanished = NULL;
+    struct timespec started, finished;
+    char root[MAX_PATH_LENGTH];
+    int capacity = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    queue.jobs = NULL;
+    queue.count = 0;
+    queue.next = 0;
+
+    // Canonical path, so the same folder reached another way maps to the same cache keys
+    char* resolved = realpath(folder, NULL);
+    if (resolved == NULL || strlen(resolved) >= sizeof(root)) {
+        printf("Could not open folder '%s'!\n", folder);
+        free(resolved);
+        return;
+    }
+    strcpy(root, resolved);
+    free(resolved);
+    size_t rootLength = strlen(root);
+    if (rootLength == 1) rootLength = 0; // "/" itself: children are "/name"
+
+    int collected = collectFiles(root, &queue, &capacity, 0);
+    if (collected == -2) {
+        printf("Could not open folder '%s'!\n", root);
+        return;
+    }
+
+    // Playlist nodes by ID: finds changed songs in O(1) and keeps new IDs
+    // clear of typed-in ones
+    if (collected == -1 || reserveLibraryCache(cache, queue.count) != 0 || buildSongMap(&live, player) != 0) {
+        printf("Memory allocation failed!\n");
+        for (int i = 0; i < queue.count; i++) free(queue.jobs[i].path);
+        free(queue.jobs);
+        free(live.slots);
+        return;
+    }
+
+    qsort(queue.jobs, queue.count, sizeof(struct ScanJob), compareJobPaths);
+    cache->generation++;
+
+    // Songs deleted by hand since the last scan must be read again
+    for (int i = 0; i < cache->capacity; i++) {
+        struct LibraryEntry* entry = &cache->entries[i];
+        if (entry->path != NULL && entry->present && findMappedSong(&live, entry->id) == NULL) {
+            entry->present = 0;
+        }
+    }
+
+    for (int i = 0; i < queue.count; i++) {
+        queue.jobs[i].cached = findLibraryEntry(cache, queue.jobs[i].path);
+    }
+
+    // The calling thread works the queue alongside the helpers
+    pthread_t threads[SCAN_THREADS_MAX];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threadCount = cpus < 1 ? 0 : (cpus > SCAN_THREADS_MAX ? SCAN_THREADS_MAX : (int)cpus) - 1;
+    int startedThreads = 0;
+
+    pthread_mutex_init(&queue.lock, NULL);
+    for (int i = 0; i < threadCount; i++) {
+        if (pthread_create(&threads[i], NULL, scanWorker, &queue) != 0) break;
+        startedThreads++;
+    }
+    scanWorker(&queue);
+    for (int i = 0; i < startedThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+
+    int added = 0, updated = 0, moved = 0, unchanged = 0, removed = 0, unreadable = 0;
+
+    // First pass: files whose path is already known
+    for (int i = 0; i < queue.count; i++) {
+        struct ScanJob* job = &queue.jobs[i];
+        struct LibraryEntry* entry = job->cached;
+
+        // The path is still there even if it cannot be read right now, so its
+        // song stays (and is retried next scan) instead of counting as deleted
+        if (entry != NULL) entry->lastSeen = cache->generation;
+
+        if (job->status == SCAN_FAILED) {
+            unreadable++;
+            continue;
+        }
+        if (job->status == SCAN_UNCHANGED) {
+            unchanged++;
+            continue;
+        }
+        if (entry == NULL || entry->id <= 0) continue; // new path, handled below
+
+        struct Song* existing = entry->present ? findMappedSong(&live, entry->id) : NULL;
+        if (existing != NULL) {
+            updateSongFromTags(existing, job->tags);
+            if (entry->hash != job->hash) idSetInsert(&staleVectors, entry->id); // audio changed
+            updated++;
+        } else {
+            job->song = createSong(entry->id, job->tags->title, job->tags->artist, job->tags->album, job->tags->duration);
+            if (job->song == NULL) {
+                unreadable++;
+                continue;
+            }
+            added++;
+        }
+
+        entry->mtime = job->mtime;
+        entry->size = job->size;
+        entry->hash = job->hash;
+        entry->present = 1;
+    }
+
+    // Entries under this folder whose path was not listed: deleted, or moved to a new path
+    int vanishedCount = 0;
+    for (int i = 0; i < cache->capacity; i++) {
+        struct LibraryEntry* entry = &cache->entries[i];
+        if (entry->path == NULL || entry->id <= 0 || entry->lastSeen == cache->generation) continue;
+        if (strncmp(entry->path, root, rootLength) != 0 || entry->path[rootLength] != '/') continue;
+
+        if (vanished == NULL) {
+            vanished = (struct LibraryEntry**)malloc(cache->count * sizeof(struct LibraryEntry*));
+            if (vanished == NULL) break;
+        }
+        vanished[vanishedCount++] = entry;
+    }
+    if (vanishedCount > 1) qsort(vanished, vanishedCount, sizeof(struct LibraryEntry*), compareEntryHashes);
+
+    // Second pass: new paths take over the ID of a vanished file with the same content
+    for (int i = 0; i < queue.count; i++) {
+        struct ScanJob* job = &queue.jobs[i];
+        struct LibraryEntry* entry = job->cached;
+
+        if (job->status != SCAN_READ || (entry != NULL && entry->id > 0)) continue;
+
+        if (entry == NULL) {
+            entry = insertLibraryEntry(cache, job->path);
+            if (entry == NULL) {
+                unreadable++;
+                continue;
+            }
+        }
+
+        struct LibraryEntry* previous = claimVanishedEntry(vanished, vanishedCount, job->hash);
+        struct Song* existing = NULL;
+        if (previous != NULL) {
+            entry->id = previous->id;
+            if (previous->present) existing = findMappedSong(&live, previous->id);
+            previous->id = 0;
+            previous->present = 0;
+        } else {
+            entry->id = assignLibraryId(cache, &live, job->hash);
+        }
+
+        if (existing != NULL) {
+            updateSongFromTags(existing, job->tags);
+            moved++;
+        } else if (entry->id > 0) {
+            job->song = createSong(entry->id, job->tags->title, job->tags->artist, job->tags->album, job->tags->duration);
+        }
+
+        if (existing == NULL && job->song == NULL) {
+            entry->id = 0; // retry on the next scan
+            unreadable++;
+            continue;
+        }
+        if (job->song != NULL) added++;
+
+        entry->mtime = job->mtime;
+        entry->size = job->size;
+        entry->hash = job->hash;
+        entry->present = 1;
+        entry->lastSeen = cache->generation;
+    }
+
+    // Chain the new nodes in path order for one batch insert
+    struct Song* first = NULL;
+    struct Song* last = NULL;
+    for (int i = 0; i < queue.count; i++) {
+        struct ScanJob* job = &queue.jobs[i];
+        if (job->song != NULL) {
+            if (first == NULL) {
+                first = job->song;
+            } else {
+                last->next = job->song;
+                job->song->prev = last;
+            }
+            last = job->song;
+        }
+        free(job->tags);
+        free(job->path);
+    }
+    free(queue.jobs);
+    addSongBatch(player, first, last, added);
+
+    // Vanished files nobody claimed are gone: unlink their songs directly
+    for (int i = 0; i < vanishedCount; i++) {
+        struct LibraryEntry* entry = vanished[i];
+        if (entry->id <= 0 || !entry->present) continue;
+
+        struct Song* song = findMappedSong(&live, entry->id);
+        if (song != NULL) {
+            detachSong(player, song);
+            free(song);
+            removed++;
+        }
+        idSetInsert(&staleVectors, entry->id);
+        entry->present = 0;
+    }
+    removeIdsFromIndex(&player->similar, &staleVectors);
+
+    free(vanished);
+    free(live.slots);
+    freeIdSet(&staleVectors);
+
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+    printf("Scanned %d file(s) in %.2f s: %d added, %d updated, %d moved, %d unchanged, %d removed, %d unreadable\n",
+           queue.count, seconds, added, updated, moved, unchanged, removed, unreadable);
+}
+#else
+// Folder scanning is POSIX-only (see the includes)
+void scanLibrary(struct MusicPlayer* player, const char* folder) {
+    (void)player;
+    (void)folder;
+    printf("Folder scanning is not supported in native Windows builds; use WSL or Cygwin!\n");
+}
+#endif
+
+#ifndef NO_STATS
+// Counters for every thread that has recorded an operation
+// Blocks are only ever appended, so the dump can walk the list lock-free.
+static THREAD_LOCAL struct ThreadStats* threadStats = NULL;
+static struct ThreadStats* volatile allThreadStats = NULL;
+#ifndef _WIN32
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER; // Windows builds have no scan threads
+#endif
+
+static const char* const operationNames[OP_COUNT] = {
+    "addSong", "deleteSong", "searchSong", "searchSongByArtist", "jumpToSong",
+    "shufflePlaylist", "reversePlaylist", "playCurrentSong", "playNext",
+    "playPrevious", "pauseSong", "stopSong", "addSongAtPosition",
+    "deleteSongByTitle", "playSimilarNext"
+};
+
+// Read a monotonic clock for latency measurements
+void readClock(struct timespec* now) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    now->tv_sec = (time_t)(counter.QuadPart / frequency.QuadPart);
+    now->tv_nsec = (long)(counter.QuadPart % frequency.QuadPart * 1000000000LL / frequency.QuadPart);
+#else
+    clock_gettime(CLOCK_MONOTONIC, now);
+#endif
+}
+
+// Record one finished operation in the calling thread's counters
+void recordOperation(int op, const struct timespec* start, long visited) {
+    struct timespec end;
+    readClock(&end);
+
+    if (threadStats == NULL) {
+        struct ThreadStats* stats = (struct ThreadStats*)calloc(1, sizeof(struct ThreadStats));
+        if (stats == NULL) return;
+
+#ifndef _WIN32
+        pthread_mutex_lock(&statsLock);
+#endif
+        stats->next = allThreadStats;
+        allThreadStats = stats;
+#ifndef _WIN32
+        pthread_mutex_unlock(&statsLock);
+#endif
+        threadStats = stats;
+    }
+
+    long long elapsed = (long long)(end.tv_sec - start->tv_sec) * 1000000000LL + (end.tv_nsec - start->tv_nsec);
+    unsigned long long nanos = elapsed > 0 ? (unsigned long long)elapsed : 0;
+    int bucket = 0;
+    for (unsigned long long rest = nanos >> 1; rest != 0 && bucket < LATENCY_BUCKETS - 1; rest >>= 1) {
+        bucket++;
+    }
+
+    struct OperationStats* stats = &threadStats->ops[op];
+    stats->calls++;
+    stats->nodesVisited += (unsigned long long)visited;
+    stats->totalNanos += nanos;
+    stats->buckets[bucket]++;
+}
+
+// Append text to the JSON buffer, always leaving room for the terminator
+static size_t appendText(char* buffer, size_t size, size_t used, const char* text) {
+    while (*text != 0 && used + 1 < size) {
+        buffer[used++] = *text++;
+    }
+    buffer[used] = 0;
+    return used;
+}
+
+static size_t appendNumber(char* buffer, size_t size, size_t used, unsigned long long value) {
+    char digits[24];
+    int length = 0;
+
+    do {
+        digits[length++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    char text[24];
+    for (int i = 0; i < length; i++) {
+        text[i] = digits[length - 1 - i];
+    }
+    text[length] = 0;
+    return appendText(buffer, size, used, text);
+}
+
+// Sum all threads' counters into a JSON document
+// Uses no stdio or allocation so it can run inside a signal handler.
+// Histogram keys are the lower bound of each bucket in nanoseconds. If the
+// buffer is too small the output is an error object instead of partial JSON. Each
+// user-level call is recorded once, under the operation that was invoked;
+// shared helpers such as startPlayback are not recorded on their own.
+size_t formatStatsJson(char* buffer, size_t size) {
+    size_t used = appendText(buffer, size, 0, "{\"operations\":{");
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        struct OperationStats total;
+        memset(&total, 0, sizeof(total));
+
+        for (struct ThreadStats* stats = allThreadStats; stats != NULL; stats = stats->next) {
+            const struct OperationStats* ops = &stats->ops[op];
+            total.calls += ops->calls;
+            total.nodesVisited += ops->nodesVisited;
+            total.totalNanos += ops->totalNanos;
+            for (int b = 0; b < LATENCY_BUCKETS; b++) {
+                total.buckets[b] += ops->buckets[b];
+            }
+        }
+
+        used = appendText(buffer, size, used, op == 0 ? "\"" : ",\"");
+        used = appendText(buffer, size, used, operationNames[op]);
+        used = appendText(buffer, size, used, "\":{\"calls\":");
+        used = appendNumber(buffer, size, used, total.calls);
+        used = appendText(buffer, size, used, ",\"nodesVisited\":");
+        used = appendNumber(buffer, size, used, total.nodesVisited);
+        used = appendText(buffer, size, used, ",\"totalNs\":");
+        used = appendNumber(buffer, size, used, total.totalNanos);
+        used = appendText(buffer, size, used, ",\"latencyNs\":{");
+
+        int first = 1;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            if (total.buckets[b] == 0) continue;
+            used = appendText(buffer, size, used, first ? "\"" : ",\"");
+            used = appendNumber(buffer, size, used, b == 0 ? 0 : 1ULL << b);
+            used = appendText(buffer, size, used, "\":");
+            used = appendNumber(buffer, size, used, total.buckets[b]);
+            first = 0;
+        }
+        used = appendText(buffer, size, used, "}}");
+    }
+
+    used = appendText(buffer, size, used, "}}\n");
+    if (used + 1 >= size) {
+        // Truncated: replace the partial document with a valid one
+        used = appendText(buffer, size, 0, "{\"error\":\"stats buffer too small\"}\n");
+    }
+    return used;
+}
+
+// Write all counters as JSON to a file descriptor
+static void writeStats(int fd) {
+    char buffer[STATS_BUFFER_SIZE];
+    size_t length = formatStatsJson(buffer, sizeof(buffer));
+    size_t written = 0;
+
+    while (written < length) {
+        long result = (long)write(fd, buffer + written, (unsigned int)(length - written));
+        if (result <= 0) break;
+        written += (size_t)result;
+    }
+}
+
+#ifdef SIGUSR1
+// SIGUSR1 handler: dump the counters to stderr without touching stdio
+static void handleStatsSignal(int signo) {
+    (void)signo;
+    writeStats(STDERR_FILENO);
+}
+#endif
+#endif
+
+// Print operation counters and latency histograms as JSON
+void dumpStats() {
+#ifdef NO_STATS
+    printf("Statistics were compiled out (built with -DNO_STATS)!\n");
+#else
+    fflush(stdout);
+    writeStats(STDOUT_FILENO);
+#endif
+}
+
+// Display menu
+void displayMenu() {
+    printf("\n=== MUSIC PLAYER MENU ===\n");
+    printf("1.  Add song to playlist\n");
+    printf("2.  Add song at specific position\n");
+    printf("3.  Delete song by ID\n");
+    printf("4.  Delete song by title\n");
+    printf("5.  Play current song\n");
+    printf("6.  Play next song\n");
+    printf("7.  Play previous song\n");
+    printf("8.  Peek next song\n");
+    printf("9.  Peek previous song\n");
+    printf("10. Pause song\n");
+    printf("11. Stop song\n");
+    printf("12. Display playlist\n");
+    printf("13. Display current song\n");
+    printf("14. Search song by title\n");
+    printf("15. Search songs by artist\n");
+    printf("16. Jump to song by ID\n");
+    printf("17. Shuffle playlist\n");
+    printf("18. Reverse playlist\n");
+    printf("19. Clear playlist\n");
+    printf("20. Get playlist length\n");
+    printf("21. Analyse song audio (WAV)\n");
+    printf("22. Play similar song next\n");
+    printf("23. Find near-duplicate recordings\n");
+    printf("24. Scan music folder\n");
+    printf("25. Dump operation stats (JSON)\n");
+    printf("0.  Exit\n");
+    printf("Enter your choice: ");
+}
+
+// Main function
+int main() {
+    struct MusicPlayer player;
+    initPlayer(&player);
+
+#if !defined(NO_STATS) && defined(SIGUSR1)
+    signal(SIGUSR1, handleStatsSignal);
+#endif
+
+    int choice;
+    int id, position, duration;
+    char title[100], artist[100], album[100];
+    char path[MAX_PATH_LENGTH];
+
+    printf("Welcome to the Music Player!\n");
+
+    // Add some sample songs
+    addSong(&player, 1, "Bohemian Rhapsody", "Queen", "A Night at the Opera", 355);
+    addSong(&player, 2, "Hotel California", "Eagles", "Hotel California", 391);
+    addSong(&player, 3, "Sweet Child O' Mine", "Guns N' Roses", "Appetite for Destruction", 356);
+    addSong(&player, 4, "Stairway to Heaven", "Led Zeppelin", "Led Zeppelin IV", 482);
+    addSong(&player, 5, "Imagine", "John Lennon", "Imagine", 183);
+
+    do {
+        displayMenu();
+        scanf("%d", &choice);
+        getchar(); // consume newline
+
+        switch (choice) {
+            case 1:
+                printf("Enter song details:\n");
+                printf("ID: ");
+                scanf("%d", &id);
+                getchar();
+                printf("Title: ");
+                fgets(title, sizeof(title), stdin);
+                title[strcspn(title, "\n")] = 0; // remove newline
+                printf("Artist: ");
+                fgets(artist, sizeof(artist), stdin);
+                artist[strcspn(artist, "\n")] = 0;
+                printf("Album: ");
+                fgets(album, sizeof(album), stdin);
+                album[strcspn(album, "\n")] = 0;
+                printf("Duration (seconds): ");
+                scanf("%d", &duration);
+                addSong(&player, id, title, artist, album, duration);
+                break;
+
+            case 2:
+                printf("Enter position: ");
+                scanf("%d", &position);
+                printf("Enter song details:\n");
+                printf("ID: ");
+                scanf("%d", &id);
+                getchar();
+                printf("Title: ");
+                fgets(title, sizeof(title), stdin);
+                title[strcspn(title, "\n")] = 0;
+                printf("Artist: ");
+                fgets(artist, sizeof(artist), stdin);
+                artist[strcspn(artist, "\n")] = 0;
+                printf("Album: ");
+                fgets(album, sizeof(album), stdin);
+                album[strcspn(album, "\n")] = 0;
+                printf("Duration (seconds): ");
+                scanf("%d", &duration);
+                addSongAtPosition(&player, position, id, title, artist, album, duration);
+                break;
+
+            case 3:
+                printf("Enter song ID to delete: ");
+                scanf("%d", &id);
+                deleteSong(&player, id);
+                break;
+
+            case 4:
+                printf("Enter song title to delete: ");
+                fgets(title, sizeof(title), stdin);
+                title[strcspn(title, "\n")] = 0;
+                deleteSongByTitle(&player, title);
+                break;
+
+            case 5:
+                playCurrentSong(&player);
+                break;
+
+            case 6:
+                playNext(&player);
+                break;
+
+            case 7:
+                playPrevious(&player);
+                break;
+
+            case 8:
+                peekNext(&player);
+                break;
+
+            case 9:
+                peekPrevious(&player);
+                break;
+
+            case 10:
+                pauseSong(&player);
+                break;
+
+            case 11:
+                stopSong(&player);
+                break;
 
             case 12:
                 displayPlaylist(&player);
@@ -689,6 +2793,35 @@ int main() {
                 printf("Total songs in playlist: %d\n", getPlaylistLength(&player));
                 break;
 
+            case 21:
+                printf("Enter song ID to analyse: ");
+                scanf("%d", &id);
+                getchar();
+                printf("WAV file path: ");
+                fgets(path, sizeof(path), stdin);
+                path[strcspn(path, "\n")] = 0;
+                analyzeSongAudio(&player, id, path);
+                break;
+
+            case 22:
+                playSimilarNext(&player);
+                break;
+
+            case 23:
+                findNearDuplicates(&player);
+                break;
+
+            case 24:
+                printf("Folder path: ");
+                fgets(path, sizeof(path), stdin);
+                path[strcspn(path, "\n")] = 0;
+                scanLibrary(&player, path);
+                break;
+
+            case 25:
+                dumpStats();
+                break;
+
             case 0:
                 printf("Thank you for using the Music Player!\n");
                 clearPlaylist(&player);